@@ -8,6 +8,11 @@
 #include <cstdint>
 #include <cstdlib>
 #include <tuple>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include "trimmer.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -22,143 +27,3534 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <fstream>
+#include <sstream>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <climits>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <new>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <pwd.h>
+#include <unordered_set>
+#include <cctype>
+#include <type_traits>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#endif
+
+// Contract (inputs/outputs):
+// - trimCurrentProcessWorkingSet(): no input, attempts to reduce current process
+//   working set (free memory back to OS). Prints before/after stats. Trims
+//   through ex1::trimNow(), so under jemalloc or tcmalloc their purge API is
+//   used instead of malloc_trim. Services that want this in-process link the
+//   ex1trim library (scr/trimmer.h: background trims on idle, PSI, RSS growth).
+// - trimArenasOfCurrentProcess(opts): trim --arenas, a targeted trim of the
+//   arenas with the most free memory under a pause budget (ex1::trimArenas).
+// - trimRemoteProcess(pid, command) (Linux): trim --pid asks the LD_PRELOAD
+//   agent in another process to trim itself over an abstract unix socket.
+// - listHighMemoryProcesses(thresholdMB): returns vector of (pid, name, rssBytes)
+//   (POSIX: a ProcessList of fixed-size ProcessRecords with the comm inline;
+//   ProcessTable is its struct-of-arrays form for sort/aggregate passes;
+//   sortProcessList orders rows for list/watch --sort with an LSD radix sort)
+// - tryTerminateProcess(pid) (Windows): attempts to terminate process, returns
+//   success bool. POSIX terminates through terminateListed below.
+// - ProcessDetailsCache (POSIX): cmdline/exe/cwd for printed rows only (list and
+//   watch --cmdline), capped in length and cached by pid + starttime.
+// - OwnerResolver (POSIX): --owner user/container columns from interned,
+//   hash-cached uid and cgroup-path tables kept across scans.
+//   (POSIX: listHighMemoryProcesses can capture pidfds so the signal cannot hit
+//   a reused pid)
+// - KillPlan (POSIX): victim policy evaluated during the scan (protected comms
+//   via a perfect hash, uid, cgroup, oom_score_adj, age); scores and orders
+//   the accepted candidates into a kill plan.
+// - terminateListed(procs, handles, graceMs) (POSIX): SIGTERM to all victims at
+//   once, SIGKILL (plus process_mrelease on Linux) per victim after the grace
+//   period; reports each exit time and how far MemAvailable recovered.
+// - runWatch(opts) (Linux): rescans periodically; the interval adapts to memory
+//   pressure and fork churn and is paced to a CPU budget for the scans.
+//   With --delta only appeared/disappeared/changed rows are printed; --record
+//   appends every scan to a columnar history file read back by runQuery().
+//   --cgroup-reclaim periodically reclaims from the coldest cgroups.
+// - runCgroupReclaim(opts) (Linux): writes to a cgroup v2 memory.reclaim in
+//   steps and reports the bytes reclaimed and time spent.
+// - runServe(opts) (Linux): serves the latest scan as OpenMetrics over HTTP.
+// - runReclaim(opts) (Linux): kills the fewest policy-approved victims whose
+//   unique memory covers a target, then checks MemAvailable against it.
+// - tryPageOutProcess(pid, pidfd, advice, result) (Linux): process_madvise
+//   MADV_PAGEOUT/MADV_COLD over the anonymous VMAs; reports the RSS change.
+// - freezeListed/runThaw (Linux): list --freeze stops victims via their own
+//   cgroup's cgroup.freeze or SIGSTOP, optionally escalating to SIGKILL after
+//   a timeout; thaw resumes them.
+// - stopProcessTrees(roots, mode, handles) (Linux): snapshots and SIGSTOPs the
+//   subtree or process group of each victim for list --kill-tree/--kill-pgid.
+// - printFreedPrediction(rows, pagemap) (Linux): --dry-run report of the
+//   memory a kill would free (USS per victim, optional pagemap accounting).
+// - runStats(opts) (Linux): per-phase scan latency, syscall, byte and allocation counters.
+// Error modes: lack of privileges, process gone between enumeration and action.
+
+// Sort keys for list/watch --sort. Metrics sort largest first, name sorts
+// ascending; later keys break ties of earlier ones and pid breaks the rest.
+enum SortKey { SortRss, SortPss, SortSwap, SortGrowth, SortName };
+
+static bool parseSortKeys(const std::string& spec, std::vector<SortKey>& keys) {
+    keys.clear();
+    std::stringstream ss(spec);
+    std::string k;
+    while (std::getline(ss, k, ',')) {
+        if (k == "rss") keys.push_back(SortRss);
+        else if (k == "pss") keys.push_back(SortPss);
+        else if (k == "swap") keys.push_back(SortSwap);
+        else if (k == "growth") keys.push_back(SortGrowth);
+        else if (k == "name") keys.push_back(SortName);
+        else return false;
+    }
+    return !keys.empty();
+}
+
+#ifdef _WIN32
+static SIZE_T getProcessWorkingSet(HANDLE hProcess) {
+    PROCESS_MEMORY_COUNTERS pmc = {};
+    if (GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc))) {
+        return pmc.WorkingSetSize;
+    }
+    return 0;
+}
+
+// Helper: convert TCHAR (ANSI or WCHAR) to UTF-8 std::string
+static std::string tchar_to_utf8(const TCHAR* s) {
+#ifdef UNICODE
+    if (!s) return std::string();
+    int needed = WideCharToMultiByte(CP_UTF8, 0, s, -1, nullptr, 0, nullptr, nullptr);
+    if (needed <= 0) return std::string();
+    std::string out(needed, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, s, -1, &out[0], needed, nullptr, nullptr);
+    // remove trailing null
+    if (!out.empty() && out.back() == '\0') out.pop_back();
+    return out;
+#else
+    return std::string(s ? s : "");
+#endif
+}
+
+void trimCurrentProcessWorkingSet() {
+    HANDLE h = GetCurrentProcess();
+    SIZE_T before = getProcessWorkingSet(h);
+    std::cout << "Before trim: " << (before / 1024) << " KB\n";
+
+    // Ask the OS to trim the working set for this process.
+    // Passing -1 for min and max is a documented technique to tell Windows to trim.
+    if (!SetProcessWorkingSetSize(h, (SIZE_T)-1, (SIZE_T)-1)) {
+        std::cerr << "SetProcessWorkingSetSize failed, error=" << GetLastError() << "\n";
+    }
+
+    SIZE_T after = getProcessWorkingSet(h);
+    std::cout << "After  trim: " << (after / 1024) << " KB\n";
+}
+
+std::vector<std::tuple<DWORD, std::string, SIZE_T>> listHighMemoryProcesses(size_t thresholdMB) {
+    std::vector<std::tuple<DWORD, std::string, SIZE_T>> out;
+    HANDLE snap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snap == INVALID_HANDLE_VALUE) return out;
+
+    PROCESSENTRY32 pe;
+    pe.dwSize = sizeof(pe);
+    if (Process32First(snap, &pe)) {
+        do {
+            DWORD pid = pe.th32ProcessID;
+            std::string name = tchar_to_utf8(pe.szExeFile);
+            HANDLE h = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+            SIZE_T rss = 0;
+            if (h) {
+                rss = getProcessWorkingSet(h);
+                CloseHandle(h);
+            }
+            if (rss >= thresholdMB * 1024ULL * 1024ULL) {
+                out.emplace_back(pid, name, rss);
+            }
+        } while (Process32Next(snap, &pe));
+    }
+    CloseHandle(snap);
+    return out;
+}
+
+bool tryTerminateProcess(DWORD pid) {
+    HANDLE h = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
+    if (!h) return false;
+    BOOL ok = TerminateProcess(h, 1);
+    CloseHandle(h);
+    return ok == TRUE;
+}
+
+#else // POSIX (Linux/macOS) - best-effort implementations
+
+#ifdef __linux__
+// VmRSS and RssAnon of the current process, in KB. Read into a stack buffer
+// so taking the sample does not itself allocate between before and after.
+static void readSelfRss(unsigned long long& rssKB, unsigned long long& anonKB) {
+    char buf[4096];
+    rssKB = anonKB = 0;
+    int fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return;
+    buf[n] = '\0';
+    const char* p;
+    if ((p = strstr(buf, "\nVmRSS:")) != nullptr) rssKB = strtoull(p + 7, nullptr, 10);
+    if ((p = strstr(buf, "\nRssAnon:")) != nullptr) anonKB = strtoull(p + 9, nullptr, 10);
+}
+
+// A trim cannot add memory: an RSS that grew across it is noise from other
+// threads or page faults in the window, shown as such rather than as a
+// negative release.
+static void printReleased(const char* what, unsigned long long before, unsigned long long after) {
+    if (after <= before) std::cout << (before - after) << " KB " << what;
+    else std::cout << "0 KB " << what << " (grew " << (after - before) << " KB, noise)";
+}
+#endif
+
+void trimCurrentProcessWorkingSet() {
+#ifdef __linux__
+    // The allocator-aware trim is the one services get from ex1trim: the
+    // jemalloc or tcmalloc purge API when one of them provides malloc, else
+    // malloc_trim. Measure what it actually gave back and what it cost, so it
+    // can be judged per service. Snapshot the arenas first so the report's
+    // own allocations land before the RSS measurement, not between the two.
+    std::vector<ex1::MallocArenaInfo> arenasBefore = ex1::mallocArenaInfo();
+    unsigned long long rssBefore, anonBefore, rssAfter, anonAfter;
+    readSelfRss(rssBefore, anonBefore);
+    #if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 mb = mallinfo2();
+    #endif
+
+    ex1::TrimResult r;
+    if (!ex1::trimNow(r)) {
+        std::cout << "No allocator trim available on this platform.\n";
+        return;
+    }
+    readSelfRss(rssAfter, anonAfter);
+    bool glibc = strcmp(r.allocator, "glibc") == 0;
+
+    std::cout << "Before trim: " << rssBefore << " KB (anon " << anonBefore << " KB)\n";
+    #if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    if (glibc) {
+        std::cout << "  heap: arena " << mb.arena / 1024 << " KB, in use " << mb.uordblks / 1024 << " KB, free "
+                  << mb.fordblks / 1024 << " KB (fast " << mb.fsmblks / 1024 << " KB), mmap " << mb.hblkhd / 1024
+                  << " KB, releasable top " << mb.keepcost / 1024 << " KB\n";
+    }
+    #endif
+    std::cout << r.allocator << " trim in " << r.wallMs << " ms (cpu " << r.cpuMs << " ms), released "
+              << r.releasedKB << " KB\n";
+    std::cout << "After  trim: " << rssAfter << " KB (anon " << anonAfter << " KB)\n";
+    #if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    if (glibc) {
+        struct mallinfo2 ma = mallinfo2();
+        std::cout << "  heap: arena " << ma.arena / 1024 << " KB, in use " << ma.uordblks / 1024 << " KB, free "
+                  << ma.fordblks / 1024 << " KB (fast " << ma.fsmblks / 1024 << " KB), mmap " << ma.hblkhd / 1024
+                  << " KB, releasable top " << ma.keepcost / 1024 << " KB\n";
+    }
+    #endif
+    std::cout << "Released: ";
+    printReleased("RSS", rssBefore, rssAfter);
+    std::cout << ", ";
+    printReleased("anon", anonBefore, anonAfter);
+    std::cout << "\n";
+    if (!glibc) return;
+
+    // malloc_trim leaves free chunks in place (it only drops their pages), so
+    // "free" stays put; "system" shrinks when a top chunk was given back.
+    std::vector<ex1::MallocArenaInfo> arenasAfter = ex1::mallocArenaInfo();
+    std::cout << "arena    systemKB     usedKB     freeKB   fastKB(n)        binsKB(n)\n";
+    for (size_t i = 0; i < arenasBefore.size(); ++i) {
+        const ex1::MallocArenaInfo& a = arenasBefore[i];
+        unsigned long long free = a.fastBytes + a.restBytes;
+        unsigned long long sysAfter = i < arenasAfter.size() ? arenasAfter[i].systemBytes : a.systemBytes;
+        char line[160];
+        snprintf(line, sizeof(line), "%5d %6llu->%-6llu %9llu %10llu %8llu(%llu) %10llu(%llu)\n", a.nr,
+                 (unsigned long long)a.systemBytes / 1024, sysAfter / 1024,
+                 (a.systemBytes > free ? a.systemBytes - free : 0) / 1024, free / 1024,
+                 (unsigned long long)a.fastBytes / 1024, (unsigned long long)a.fastCount,
+                 (unsigned long long)a.restBytes / 1024, (unsigned long long)a.restCount);
+        std::cout << line;
+    }
+#else
+    std::cout << "No portable trim available on this POSIX platform.\n";
+#endif
+}
+
+#ifdef __linux__
+// Remote trim: asks the LD_PRELOAD agent (libex1trim_agent.so, see
+// scr/trim_agent.cpp) inside pid to trim its own heap and prints its reply.
+int trimRemoteProcess(pid_t pid, const std::string& command) {
+    struct sockaddr_un sun = {};
+    sun.sun_family = AF_UNIX;
+    int nameLen = snprintf(sun.sun_path + 1, sizeof(sun.sun_path) - 1, "ex1trim.%d", (int)pid);
+    socklen_t len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + nameLen);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { std::cout << "socket: " << strerror(errno) << "\n"; return 1; }
+    if (connect(fd, (struct sockaddr*)&sun, len) != 0) {
+        int err = errno;
+        close(fd);
+        if (err == ECONNREFUSED || err == ENOENT)
+            std::cout << "PID " << pid << " has no trim agent (start it with LD_PRELOAD=libex1trim_agent.so)\n";
+        else
+            std::cout << "connect to PID " << pid << ": " << strerror(err) << "\n";
+        return 1;
+    }
+    struct timeval tv = {10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::string req = command + "\n";
+    send(fd, req.data(), req.size(), MSG_NOSIGNAL);
+    std::string reply;
+    char buf[256];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) reply.append(buf, (size_t)n);
+    close(fd);
+    if (reply.empty()) { std::cout << "PID " << pid << ": no reply from trim agent\n"; return 1; }
+    if (reply.compare(0, 3, "ok ") != 0) { std::cout << "PID " << pid << ": " << reply; return 1; }
+
+    // "ok key=value ...": one field per line, with the RSS delta for trims.
+    std::istringstream fields(reply.substr(3));
+    std::string kv;
+    unsigned long long before = 0, after = 0;
+    std::cout << "PID " << pid << " " << command << ":\n";
+    while (fields >> kv) {
+        size_t eq = kv.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = kv.substr(0, eq), val = kv.substr(eq + 1);
+        if (key == "rss_before_kb") before = std::strtoull(val.c_str(), nullptr, 10);
+        if (key == "rss_after_kb") after = std::strtoull(val.c_str(), nullptr, 10);
+        if (key == "arena") {
+            // nr:free_kb:released_kb:pause_ms:trimmed
+            std::replace(val.begin(), val.end(), ':', ' ');
+            std::istringstream f(val);
+            std::string nr, freeKB, releasedKB, pauseMs, trimmed;
+            f >> nr >> freeKB >> releasedKB >> pauseMs >> trimmed;
+            if (nr == "-1") nr = "all";
+            std::cout << "  arena " << nr << ": free " << freeKB << " KB, released " << releasedKB << " KB, pause "
+                      << pauseMs << " ms" << (trimmed == "1" ? "" : " (not trimmed)") << "\n";
+            continue;
+        }
+        std::cout << "  " << key << ": " << val << "\n";
+    }
+    if (before) std::cout << "  RSS change: " << ((long long)after - (long long)before) << " KB\n";
+    return 0;
+}
+#endif
+
+#ifdef __linux__
+// ---------------------------------------------------------------------------
+// Scan instrumentation. Every scan records the time spent per phase into
+// HDR-style histograms and counts the syscalls, /proc bytes and heap
+// allocations it caused. Recording is a few additions per scan plus one vDSO
+// clock read per file, so it is always on.
+// ---------------------------------------------------------------------------
+
+enum ScanPhase { PhaseEnumerate, PhaseRead, PhaseParse, PhaseFilter, PhaseOutput, PhaseTotal, PhaseCount };
+static const char* const kScanPhaseNames[PhaseCount] = {"enumerate", "read", "parse", "filter", "output", "total"};
+
+enum ScanSyscall {
+    SysGetdents, SysOpen, SysRead, SysClose, SysPidfdOpen, SysPidfdSignal, SysMrelease, SysMadvise, SysReadlink,
+    SysCount
+};
+static const char* const kScanSyscallNames[SysCount] = {"getdents64", "open", "read", "close", "pidfd_open",
+                                                        "pidfd_send_signal", "process_mrelease", "process_madvise",
+                                                        "readlink"};
+
+// Log-linear histogram of nanosecond values: 16 linear sub-buckets per power
+// of two, i.e. about 6% relative error over the whole 64-bit range.
+class LatencyHistogram {
+public:
+    void record(uint64_t v) {
+        ++buckets_[index(v)];
+        ++count_;
+        sum_ += v;
+        if (v > max_) max_ = v;
+    }
+    uint64_t count() const { return count_; }
+    uint64_t sum() const { return sum_; }
+    uint64_t max() const { return max_; }
+    // Upper bound of the bucket holding the q-quantile (q in [0,1]).
+    uint64_t quantile(double q) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = (uint64_t)(q * (count_ - 1)) + 1, seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) return std::min(upperBound(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static const size_t kSubBits = 4;
+    static const size_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+    static size_t index(uint64_t v) {
+        if (v < (1u << kSubBits)) return (size_t)v;
+        unsigned msb = 63 - __builtin_clzll(v);
+        return ((size_t)(msb - kSubBits + 1) << kSubBits) + (size_t)((v >> (msb - kSubBits)) & ((1u << kSubBits) - 1));
+    }
+    static uint64_t upperBound(size_t i) {
+        if (i < (1u << kSubBits)) return i;
+        unsigned msb = (unsigned)(i >> kSubBits) + kSubBits - 1;
+        uint64_t sub = i & ((1u << kSubBits) - 1);
+        return ((((uint64_t)1 << kSubBits) | sub) << (msb - kSubBits)) + (((uint64_t)1 << (msb - kSubBits)) - 1);
+    }
+
+    uint64_t buckets_[kBuckets] = {};
+    uint64_t count_ = 0, sum_ = 0, max_ = 0;
+};
+
+struct ScanCounters {
+    uint64_t scans = 0;
+    LatencyHistogram phases[PhaseCount];
+    uint64_t syscalls[SysCount] = {};
+    uint64_t procBytesRead = 0;
+    uint64_t allocations = 0;
+    uint64_t allocBytes = 0;
+    // Values of the most recent scan, for per-scan reporting.
+    uint64_t lastSyscalls = 0, lastBytes = 0, lastAllocations = 0, lastPids = 0;
+
+    uint64_t totalSyscalls() const {
+        uint64_t n = 0;
+        for (uint64_t c : syscalls) n += c;
+        return n;
+    }
+};
+
+// Owned by the scanning thread (the main thread, or the scanner thread in serve).
+static ScanCounters g_scanStats;
+
+// Heap allocations of the calling thread, maintained by the operator new
+// replacement below; per-scan allocations are the delta across a scan.
+static thread_local unsigned long long t_allocCount = 0;
+static thread_local unsigned long long t_allocBytes = 0;
+
+// Counting replacement for the global allocation functions (operator new[]
+// and delete[] forward to these). Kept out of line so the compiler does not
+// pair an inlined free() with operator new and warn about a mismatch.
+__attribute__((noinline)) void* operator new(size_t n) {
+    ++t_allocCount;
+    t_allocBytes += n;
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+static uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void recordScanPhase(ScanPhase p, uint64_t ns) { g_scanStats.phases[p].record(ns); }
+
+// Reads a small /proc file with a single open/read/close where possible.
+// Returns the number of bytes read (NUL-terminated in buf) or -1.
+static ssize_t readProcFile(const char* path, char* buf, size_t cap) {
+    ++g_scanStats.syscalls[SysOpen];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    // procfs hands out small files in a single read, so one call is enough
+    // for everything read through here.
+    ssize_t r;
+    do {
+        ++g_scanStats.syscalls[SysRead];
+        r = read(fd, buf, cap - 1);
+    } while (r < 0 && errno == EINTR);
+    size_t total = r > 0 ? (size_t)r : 0;
+    ++g_scanStats.syscalls[SysClose];
+    close(fd);
+    buf[total] = '\0';
+    g_scanStats.procBytesRead += total;
+    return (ssize_t)total;
+}
+
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// Collects the numeric entries of /proc using getdents64 directly.
+static void enumeratePids(std::vector<pid_t>& pids) {
+    pids.clear();
+    ++g_scanStats.syscalls[SysOpen];
+    int fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    char buf[32768];
+    for (;;) {
+        ++g_scanStats.syscalls[SysGetdents];
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        for (long off = 0; off < n;) {
+            const LinuxDirent64* d = (const LinuxDirent64*)(buf + off);
+            off += d->d_reclen;
+            const char* c = d->d_name;
+            if (*c < '1' || *c > '9') continue;
+            pid_t pid = 0;
+            while (*c >= '0' && *c <= '9') pid = pid * 10 + (*c++ - '0');
+            if (*c == '\0') pids.push_back(pid);
+        }
+    }
+    ++g_scanStats.syscalls[SysClose];
+    close(fd);
+}
+
+// Process handles captured during a scan. pidfd_open() pins the process that
+// was measured: if it exits and its pid is reused, signals sent through the
+// pidfd fail with ESRCH instead of hitting the newcomer.
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#ifndef SYS_process_mrelease
+#define SYS_process_mrelease 448
+#endif
+#ifndef SYS_process_madvise
+#define SYS_process_madvise 440
+#endif
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+static int sysPidfdOpen(pid_t pid) {
+    ++g_scanStats.syscalls[SysPidfdOpen];
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int sysPidfdSendSignal(int pidfd, int sig) {
+    ++g_scanStats.syscalls[SysPidfdSignal];
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+}
+
+// Reaps the address space of a process with a pending SIGKILL in the
+// caller's context (Linux 5.15+), instead of waiting for its exit path.
+static int sysProcessMrelease(int pidfd) {
+    ++g_scanStats.syscalls[SysMrelease];
+    return (int)syscall(SYS_process_mrelease, pidfd, 0);
+}
+
+// Applies advice to ranges of another process (Linux 5.10+). Returns the
+// number of bytes advised.
+static ssize_t sysProcessMadvise(int pidfd, const struct iovec* iov, size_t n, int advice) {
+    ++g_scanStats.syscalls[SysMadvise];
+    return (ssize_t)syscall(SYS_process_madvise, pidfd, iov, n, advice, 0);
+}
+
+// Pss and unique (Private_Clean + Private_Dirty) bytes from smaps_rollup.
+static bool readSmapsRollup(pid_t pid, size_t& pss, size_t& uss, size_t* swap = nullptr) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pid);
+    if (readProcFile(path, buf, sizeof(buf)) <= 0) return false;
+    const char* p = strstr(buf, "\nPss:");
+    pss = p ? (size_t)strtoull(p + 5, nullptr, 10) * 1024 : 0;
+    p = strstr(buf, "\nPrivate_Clean:");
+    uss = p ? (size_t)strtoull(p + 15, nullptr, 10) * 1024 : 0;
+    p = strstr(buf, "\nPrivate_Dirty:");
+    if (p) uss += (size_t)strtoull(p + 15, nullptr, 10) * 1024;
+    if (swap) {
+        p = strstr(buf, "\nSwap:");
+        *swap = p ? (size_t)strtoull(p + 6, nullptr, 10) * 1024 : 0;
+    }
+    return true;
+}
+
+// Path part of a /proc/<pid>/cgroup file: the unified "0::/path" line (cgroup
+// v2, also present on hybrid hosts), else the third field of the first line
+// ("N:controllers:/path", v1). Returns a pointer into buf, or null.
+static const char* cgroupPathOf(const char* buf, size_t& len) {
+    const char* line = strstr(buf, "0::");
+    while (line && line != buf && line[-1] != '\n') line = strstr(line + 1, "0::");
+    const char* path = nullptr;
+    if (line) {
+        path = line + 3;
+    } else if ((path = strchr(buf, ':')) != nullptr) {
+        const char* nl = strchr(buf, '\n');
+        path = strchr(path + 1, ':');
+        if (path && nl && path > nl) path = nullptr;
+        if (path) ++path;
+    }
+    if (!path) return nullptr;
+    const char* end = strchr(path, '\n');
+    len = end ? (size_t)(end - path) : strlen(path);
+    return path;
+}
+
+static unsigned long long readMemAvailableKB() {
+    char buf[256];   // MemAvailable is the third line of /proc/meminfo
+    if (readProcFile("/proc/meminfo", buf, sizeof(buf)) <= 0) return 0;
+    const char* p = strstr(buf, "MemAvailable:");
+    return p ? strtoull(p + 13, nullptr, 10) : 0;
+}
+#endif
+
+class PidfdTable {
+public:
+    PidfdTable() = default;
+    PidfdTable(const PidfdTable&) = delete;
+    PidfdTable& operator=(const PidfdTable&) = delete;
+    ~PidfdTable() { clear(); }
+
+    // Returns the captured pidfd for pid, or -1 if none was captured.
+    int get(pid_t pid) const {
+        auto it = fds_.find(pid);
+        return it == fds_.end() ? -1 : it->second;
+    }
+    // False once pidfd_open reported ENOSYS (kernel < 5.3); callers then fall
+    // back to plain pids.
+    bool supported() const { return supported_; }
+
+    void clear() {
+        for (auto &e : fds_) close(e.second);
+        fds_.clear();
+    }
+
+#ifdef __linux__
+    // Opens a pidfd for pid. Returns the fd, or -1 if the process is gone or
+    // pidfds are unsupported.
+    int capture(pid_t pid) {
+        if (!supported_) return -1;
+        int fd = get(pid);
+        if (fd >= 0) return fd;
+        if (!limitRaised_) {
+            // One fd per candidate: bulk kills can exceed the default soft limit.
+            limitRaised_ = true;
+            struct rlimit rl;
+            if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+                rl.rlim_cur = rl.rlim_max;
+                setrlimit(RLIMIT_NOFILE, &rl);
+            }
+        }
+        fd = sysPidfdOpen(pid);
+        if (fd < 0) {
+            if (errno == ENOSYS) supported_ = false;
+            return -1;
+        }
+        fds_[pid] = fd;
+        return fd;
+    }
+    void release(pid_t pid) {
+        auto it = fds_.find(pid);
+        if (it == fds_.end()) return;
+        close(it->second);
+        fds_.erase(it);
+    }
+#endif
+
+private:
+    std::unordered_map<pid_t, int> fds_;
+    bool supported_ = true;
+    bool limitRaised_ = false;
+};
+
+// Set of command names with a perfect hash built once, before any scan:
+// FNV-1a seeds are tried until every name gets its own slot in a power-of-two
+// table, so a lookup costs one hash and at most one compare.
+class CommSet {
+public:
+    explicit CommSet(std::vector<std::string> names) {
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        names_.swap(names);
+        size_t size = 1;
+        while (size < names_.size() * 2) size <<= 1;
+        for (uint32_t seed = 1;; ++seed) {
+            if (seed % 256 == 0) size <<= 1;   // too crowded, give the seeds more room
+            slots_.assign(size, -1);
+            bool ok = true;
+            for (size_t i = 0; i < names_.size() && ok; ++i) {
+                int& s = slots_[hash(names_[i].data(), names_[i].size(), seed) & (size - 1)];
+                if (s >= 0) ok = false;
+                else s = (int)i;
+            }
+            if (ok) { seed_ = seed; break; }
+        }
+    }
+
+    bool contains(const char* s, size_t len) const {
+        int i = slots_[hash(s, len, seed_) & (slots_.size() - 1)];
+        return i >= 0 && names_[i].size() == len && memcmp(names_[i].data(), s, len) == 0;
+    }
+
+private:
+    static uint32_t hash(const char* s, size_t len, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        for (size_t i = 0; i < len; ++i) { h ^= (unsigned char)s[i]; h *= 16777619u; }
+        return h ^ (h >> 15);
+    }
+
+    std::vector<std::string> names_;
+    std::vector<int> slots_;
+    uint32_t seed_ = 0;
+};
+
+// Which candidates above the threshold may be killed, and in what order.
+struct VictimPolicy {
+    std::vector<std::string> protectedComms = {
+        "systemd", "init", "systemd-journal", "systemd-logind", "systemd-udevd", "systemd-resolve",
+        "systemd-network", "sshd", "dbus-daemon", "dbus-broker", "agetty", "login", "Xorg", "Xwayland",
+        "gnome-shell", "kwin_x11", "kwin_wayland", "containerd", "dockerd", "kubelet", "postgres",
+        "mysqld", "mariadbd", "redis-server", "ex1"};
+    bool allowRoot = false;                     // uid 0 processes are skipped unless set
+    long long onlyUid = -1;                     // >= 0: only this uid
+    std::vector<std::string> cgroups;           // only inside these cgroup prefixes (empty = any)
+    std::vector<std::string> protectedCgroups;  // never inside these cgroup prefixes
+    bool usePss = false;                        // score by PSS (smaps_rollup) instead of RSS
+    bool readUss = false;                       // also read unique (private) memory, for reclaim
+    unsigned minAgeSec = 0;                     // skip processes younger than this
+    double ageWeightPerDay = 0.1;               // score divisor growth per day of uptime
+};
+
+struct KillCandidate {
+    pid_t pid = 0;
+    std::string name;
+    size_t rss = 0;
+    size_t pss = 0;             // 0 unless the policy asks for PSS
+    size_t uss = 0;             // private clean + dirty; 0 unless the policy asks for it
+    int oomScore = 0;
+    double ageSec = 0;
+    double score = 0;
+    const char* skipReason = nullptr;
+};
+
+// Evaluates candidates while listHighMemoryProcesses walks /proc. Cheap
+// checks run first and the extra /proc reads (oom_score_adj, stat, cgroup,
+// smaps_rollup, oom_score) are only made for processes above the threshold
+// that passed them. Accepted candidates are scored
+//   mem MB * (1 + oom_score / 1000) / (1 + ageWeightPerDay * age in days)
+// so the kernel's own badness and oom_score_adj weigh in and long-running
+// services lose some priority.
+class KillPlan {
+public:
+    explicit KillPlan(const VictimPolicy& p) : policy_(p), protected_(p.protectedComms) {
+#ifdef __linux__
+        std::ifstream up("/proc/uptime");
+        up >> uptimeSec_;
+        ticksPerSec_ = (double)sysconf(_SC_CLK_TCK);
+#endif
+    }
+
+#ifdef __linux__
+    // Returns false (and records why) when the candidate must not be killed.
+    bool consider(pid_t pid, const std::string& name, size_t rss) {
+        KillCandidate c;
+        c.pid = pid;
+        c.name = name;
+        c.rss = rss;
+        if (!evaluate(c)) { skipped_.push_back(c); return false; }
+        victims_.push_back(c);
+        return true;
+    }
+#endif
+
+    // Orders the victims by descending score.
+    void finish() {
+        std::stable_sort(victims_.begin(), victims_.end(),
+                         [](const KillCandidate& a, const KillCandidate& b) { return a.score > b.score; });
+    }
+
+    const std::vector<KillCandidate>& victims() const { return victims_; }
+    const std::vector<KillCandidate>& skipped() const { return skipped_; }
+
+private:
+#ifdef __linux__
+    bool evaluate(KillCandidate& c) {
+        if (c.pid == 1) { c.skipReason = "init"; return false; }
+        if (c.pid == getpid()) { c.skipReason = "self"; return false; }
+        if (protected_.contains(c.name.data(), c.name.size())) { c.skipReason = "protected comm"; return false; }
+
+        char path[64], buf[1024];
+        struct stat st;
+        snprintf(path, sizeof(path), "/proc/%d", (int)c.pid);
+        if (stat(path, &st) != 0) { c.skipReason = "exited"; return false; }
+        if (st.st_uid == 0 && !policy_.allowRoot) { c.skipReason = "root"; return false; }
+        if (policy_.onlyUid >= 0 && (long long)st.st_uid != policy_.onlyUid) { c.skipReason = "uid"; return false; }
+
+        snprintf(path, sizeof(path), "/proc/%d/oom_score_adj", (int)c.pid);
+        if (readProcFile(path, buf, sizeof(buf)) > 0 && atoi(buf) == -1000) {
+            c.skipReason = "oom_score_adj -1000";
+            return false;
+        }
+
+        // stat: "pid (comm) state ..." with starttime the 20th field after the comm.
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)c.pid);
+        if (readProcFile(path, buf, sizeof(buf)) > 0) {
+            const char* p = strrchr(buf, ')');
+            for (int field = 0; p && field < 20; ++field) p = strchr(p + 1, ' ');
+            if (p) c.ageSec = uptimeSec_ - strtoull(p + 1, nullptr, 10) / ticksPerSec_;
+        }
+        if (c.ageSec < policy_.minAgeSec) { c.skipReason = "too young"; return false; }
+
+        if (!policy_.cgroups.empty() || !policy_.protectedCgroups.empty()) {
+            snprintf(path, sizeof(path), "/proc/%d/cgroup", (int)c.pid);
+            std::string cg = readCgroup(path, buf, sizeof(buf));
+            if (matchesPrefix(cg, policy_.protectedCgroups)) { c.skipReason = "protected cgroup"; return false; }
+            if (!policy_.cgroups.empty() && !matchesPrefix(cg, policy_.cgroups)) {
+                c.skipReason = "outside cgroup";
+                return false;
+            }
+        }
+
+        if (policy_.usePss || policy_.readUss) readSmapsRollup(c.pid, c.pss, c.uss);
+        snprintf(path, sizeof(path), "/proc/%d/oom_score", (int)c.pid);
+        if (readProcFile(path, buf, sizeof(buf)) > 0) c.oomScore = atoi(buf);
+
+        double memMB = (policy_.usePss && c.pss ? c.pss : c.rss) / 1048576.0;
+        c.score = memMB * (1.0 + c.oomScore / 1000.0) / (1.0 + policy_.ageWeightPerDay * c.ageSec / 86400.0);
+        return true;
+    }
+
+    // cgroup v2 path ("0::/path"), or the first hierarchy's path on v1.
+    static std::string readCgroup(const char* path, char* buf, size_t cap) {
+        if (readProcFile(path, buf, cap) <= 0) return std::string();
+        size_t len = 0;
+        const char* cg = cgroupPathOf(buf, len);
+        return cg ? std::string(cg, len) : std::string();
+    }
+#endif
+
+    static bool matchesPrefix(const std::string& cg, const std::vector<std::string>& prefixes) {
+        for (auto &p : prefixes) {
+            if (cg.compare(0, p.size(), p) == 0) return true;
+        }
+        return false;
+    }
+
+    VictimPolicy policy_;
+    CommSet protected_;
+    double uptimeSec_ = 0;
+    double ticksPerSec_ = 100;
+    std::vector<KillCandidate> victims_, skipped_;
+};
+
+// One row of a scan. Fixed size and trivially copyable, with the kernel
+// comm inline (TASK_COMM_LEN is 16 including the NUL), so a scan result is
+// one contiguous allocation that can be memcpy'd into shared memory or a file
+// as is. RSS is kept in KB, since RSS is a whole number of pages; 32 bits
+// cover 4 TB.
+struct ProcessRecord {
+    int32_t pid;
+    uint32_t rssKB;
+    char comm[16];
+
+    size_t rss() const { return (size_t)rssKB * 1024; }
+    std::string name() const { return std::string(comm, strnlen(comm, sizeof(comm))); }
+};
+static_assert(sizeof(ProcessRecord) == 24, "ProcessRecord layout");
+static_assert(std::is_trivially_copyable<ProcessRecord>::value, "ProcessRecord must stay memcpy-able");
+
+typedef std::vector<ProcessRecord> ProcessList;
+
+static ProcessRecord makeProcessRecord(pid_t pid, const char* comm, size_t len, size_t rssBytes) {
+    ProcessRecord r;
+    r.pid = (int32_t)pid;
+    r.rssKB = (uint32_t)std::min<size_t>(rssBytes / 1024, UINT32_MAX);
+    len = std::min(len, sizeof(r.comm) - 1);
+    memcpy(r.comm, comm, len);
+    memset(r.comm + len, 0, sizeof(r.comm) - len);
+    return r;
+}
+
+static ProcessRecord makeProcessRecord(pid_t pid, const std::string& comm, size_t rssBytes) {
+    return makeProcessRecord(pid, comm.data(), comm.size(), rssBytes);
+}
+
+// LSD radix sort of items packed as (key << 32) | row, on the 32-bit key,
+// 8 bits per pass. Stable, so sorting by the last key first gives a
+// multi-key order. Items are one 8-byte word, all four histograms come from
+// one read of the keys, and a pass whose digit is the same for every key is
+// skipped: at most four passes over 8-byte items per key. Keys are 32 bits
+// rather than 64 because every ProcessTable column fits in 32; a 64-bit key
+// would need a 16-byte item and up to eight passes. Wider digits do not pay:
+// 11 or 12 bits per pass scatter into too many buckets to stay in cache.
+static void radixSort(std::vector<uint64_t>& items, std::vector<uint64_t>& scratch) {
+    size_t n = items.size();
+    if (n < 2) return;
+    uint32_t counts[4][256] = {};
+    for (uint64_t it : items) {
+        uint32_t k = (uint32_t)(it >> 32);
+        ++counts[0][k & 0xff];
+        ++counts[1][(k >> 8) & 0xff];
+        ++counts[2][(k >> 16) & 0xff];
+        ++counts[3][k >> 24];
+    }
+    scratch.resize(n);
+    for (int d = 0; d < 4; ++d) {
+        unsigned shift = 32 + 8 * d;
+        uint32_t* c = counts[d];
+        if (c[(items[0] >> shift) & 0xff] == n) continue;   // all keys share this digit
+        uint32_t sum = 0;
+        for (int b = 0; b < 256; ++b) { uint32_t t = c[b]; c[b] = sum; sum += t; }
+        for (uint64_t it : items) scratch[c[(it >> shift) & 0xff]++] = it;
+        items.swap(scratch);
+    }
+}
+
+// Struct-of-arrays copy of a scan for sort and aggregate passes: each pass
+// walks one dense column instead of striding over whole records, and the
+// records themselves are only touched through the resulting order. pss, swap
+// and growth are filled only when a sort asks for them. watch keeps one table
+// across scans so the columns and sort buffers are not reallocated each time.
+// Every column is 32 bits, the width of a radix key: pss and swap in KB cover
+// 4 TB like rssKB, and growth is clamped to +-2 TB.
+struct ProcessTable {
+    std::vector<int32_t> pid;
+    std::vector<uint32_t> rssKB;
+    std::vector<uint32_t> pssKB, swapKB;
+    std::vector<int32_t> growthKB;
+    std::vector<uint64_t> items, scratch;   // (key << 32) | row
+    ProcessList sorted;
+
+    void assign(const ProcessList& rows) {
+        pid.resize(rows.size());
+        rssKB.resize(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            pid[i] = rows[i].pid;
+            rssKB[i] = rows[i].rssKB;
+        }
+        pssKB.clear();
+        swapKB.clear();
+        growthKB.clear();
+    }
+
+    size_t size() const { return pid.size(); }
+
+    uint64_t totalRssKB() const {
+        uint64_t sum = 0;
+        for (uint32_t v : rssKB) sum += v;
+        return sum;
+    }
+
+#ifdef __linux__
+    // One smaps_rollup read per row; only for --sort pss/swap.
+    void readSmaps() {
+        pssKB.assign(size(), 0);
+        swapKB.assign(size(), 0);
+        for (size_t i = 0; i < size(); ++i) {
+            size_t pss = 0, uss = 0, swap = 0;
+            if (readSmapsRollup(pid[i], pss, uss, &swap)) {
+                pssKB[i] = (uint32_t)std::min<size_t>(pss / 1024, UINT32_MAX);
+                swapKB[i] = (uint32_t)std::min<size_t>(swap / 1024, UINT32_MAX);
+            }
+        }
+    }
 #endif
 
-// Contract (inputs/outputs):
-// - trimCurrentProcessWorkingSet(): no input, attempts to reduce current process
-//   working set (free memory back to OS). Prints before/after stats.
-// - listHighMemoryProcesses(thresholdMB): returns vector of (pid, name, rssBytes)
-// - tryTerminateProcess(pid): attempts to terminate process, returns success bool
-// Error modes: lack of privileges, process gone between enumeration and action.
+    // RSS change against a previous scan. Rows absent from it (new processes,
+    // or ones that were below the threshold) count as growing by their whole
+    // RSS, so a process that just crossed the threshold sorts with the
+    // fastest growers rather than last.
+    void setGrowth(const std::unordered_map<int32_t, uint32_t>& previousRssKB) {
+        growthKB.resize(size());
+        for (size_t i = 0; i < size(); ++i) {
+            auto it = previousRssKB.find(pid[i]);
+            int64_t g = it != previousRssKB.end() ? (int64_t)rssKB[i] - (int64_t)it->second : (int64_t)rssKB[i];
+            growthKB[i] = (int32_t)std::max<int64_t>(INT32_MIN, std::min<int64_t>(INT32_MAX, g));
+        }
+    }
+
+    // Reorders rows (the ones passed to assign) by keys, first key most
+    // significant, ties by ascending pid. Scans come in pid order already, so
+    // the pid pass only runs when they do not.
+    void sortRows(ProcessList& rows, const std::vector<SortKey>& keys) {
+        items.resize(size());
+        bool byPid = true;
+        for (size_t i = 0; i < size(); ++i) {
+            items[i] = ((uint64_t)(uint32_t)pid[i] << 32) | i;
+            if (i > 0 && pid[i] < pid[i - 1]) byPid = false;
+        }
+        if (!byPid) radixSort(items, scratch);
+        for (size_t k = keys.size(); k-- > 0;) {
+            if (keys[k] == SortName) {
+                // The comm as a 16-byte big-endian number, 32 bits at a time
+                // from the least significant end.
+                for (int word = 3; word >= 0; --word) {
+                    for (uint64_t& it : items) {
+                        const unsigned char* c = (const unsigned char*)rows[(uint32_t)it].comm + 4 * word;
+                        uint32_t v = (uint32_t)c[0] << 24 | (uint32_t)c[1] << 16 | (uint32_t)c[2] << 8 | c[3];
+                        it = ((uint64_t)v << 32) | (uint32_t)it;
+                    }
+                    radixSort(items, scratch);
+                }
+                continue;
+            }
+            for (uint64_t& it : items) {
+                uint32_t r = (uint32_t)it;
+                uint32_t v = 0;
+                switch (keys[k]) {
+                case SortRss: v = rssKB[r]; break;
+                case SortPss: v = r < pssKB.size() ? pssKB[r] : 0; break;
+                case SortSwap: v = r < swapKB.size() ? swapKB[r] : 0; break;
+                case SortGrowth: v = (r < growthKB.size() ? (uint32_t)growthKB[r] : 0) ^ 0x80000000u; break;
+                case SortName: break;
+                }
+                it = ((uint64_t)~v << 32) | r;   // largest first
+            }
+            radixSort(items, scratch);
+        }
+        sorted.resize(rows.size());
+        for (size_t i = 0; i < items.size(); ++i) sorted[i] = rows[(uint32_t)items[i]];
+        rows.swap(sorted);
+    }
+};
+
+// Sorts rows in place by keys. previousRssKB feeds the growth key (empty when
+// there is no earlier scan); pss/swap cost an smaps_rollup read per row.
+static void sortProcessList(ProcessTable& table, ProcessList& rows, const std::vector<SortKey>& keys,
+                            const std::unordered_map<int32_t, uint32_t>& previousRssKB) {
+    table.assign(rows);
+#ifdef __linux__
+    if (std::find(keys.begin(), keys.end(), SortPss) != keys.end() ||
+        std::find(keys.begin(), keys.end(), SortSwap) != keys.end())
+        table.readSmaps();
+#endif
+    if (std::find(keys.begin(), keys.end(), SortGrowth) != keys.end()) table.setGrowth(previousRssKB);
+    table.sortRows(rows, keys);
+}
+
+static void sortProcessList(ProcessList& rows, const std::vector<SortKey>& keys,
+                            const std::unordered_map<int32_t, uint32_t>& previousRssKB) {
+    ProcessTable table;
+    sortProcessList(table, rows, keys, previousRssKB);
+}
+
+// With handles set, a pidfd is captured for every process above the
+// threshold. Only candidates pay for it: the pidfd is opened first, statm and
+// comm are re-read, and the row is kept only if the pidfd still refers to a
+// live process, so the reported numbers belong to the handle's process.
+// With plan set, candidates are also run through the victim policy in the same
+// pass and only the accepted ones are returned.
+ProcessList listHighMemoryProcesses(size_t thresholdMB, PidfdTable* handles = nullptr, KillPlan* plan = nullptr) {
+    ProcessList out;
+#ifdef __linux__
+    ScanCounters& sc = g_scanStats;
+    uint64_t sysBefore = sc.totalSyscalls();
+    uint64_t bytesBefore = sc.procBytesRead;
+    unsigned long long allocsBefore = t_allocCount, allocBytesBefore = t_allocBytes;
+    uint64_t t0 = monotonicNs();
+
+    static std::vector<pid_t> pids;   // reused across scans
+    enumeratePids(pids);
+    uint64_t t1 = monotonicNs();
+    recordScanPhase(PhaseEnumerate, t1 - t0);
+
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t threshold = thresholdMB * 1024ULL * 1024ULL;
+    uint64_t readNs = 0, parseNs = 0, filterNs = 0;
+    char path[64];
+    char buf[256];
+    uint64_t a = t1;
+    for (pid_t pid : pids) {
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+        ssize_t n = readProcFile(path, buf, sizeof(buf));
+        uint64_t b = monotonicNs();
+        readNs += b - a;
+        if (n <= 0) { a = b; continue; }   // process exited since enumeration
+
+        // statm: size resident shared text lib data dt (pages)
+        char* p = buf;
+        strtoull(p, &p, 10);
+        size_t rss = (size_t)strtoull(p, nullptr, 10) * pageSize;
+        uint64_t c = monotonicNs();
+        parseNs += c - b;
+
+        uint64_t commNs = 0;   // candidate-only reads, accounted to the read phase
+        if (rss >= threshold && handles && handles->supported()) {
+            uint64_t r0 = monotonicNs();
+            int pfd = handles->capture(pid);
+            if (pfd >= 0) {
+                // The first statm may predate a pid reuse; measure again through the pinned process.
+                n = readProcFile(path, buf, sizeof(buf));
+                p = buf;
+                strtoull(p, &p, 10);
+                rss = n > 0 ? (size_t)strtoull(p, nullptr, 10) * pageSize : 0;
+                if (rss < threshold) handles->release(pid);
+            } else if (errno == ESRCH) {
+                rss = 0;   // exited between enumeration and pidfd_open
+            } else if (handles->supported()) {
+                // e.g. EMFILE with more candidates than fds: keep the row, signal by pid.
+                std::cerr << "pidfd_open(" << pid << ") failed: " << strerror(errno)
+                          << "; falling back to plain pid\n";
+            }
+            commNs = monotonicNs() - r0;
+        }
+        if (rss >= threshold) {
+            snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+            uint64_t r0 = monotonicNs();
+            n = readProcFile(path, buf, sizeof(buf));
+            size_t len = n > 0 ? (size_t)n : 0;
+            if (len > 0 && buf[len - 1] == '\n') --len;
+            int pfd = handles ? handles->get(pid) : -1;
+            if (pfd >= 0 && sysPidfdSendSignal(pfd, 0) != 0) {
+                handles->release(pid);   // died while we were reading it
+            } else if (plan && !plan->consider(pid, std::string(buf, len), rss)) {
+                if (handles) handles->release(pid);
+            } else {
+                out.push_back(makeProcessRecord(pid, buf, len, rss));
+            }
+            commNs += monotonicNs() - r0;
+        }
+        a = monotonicNs();
+        readNs += commNs;
+        filterNs += a - c - commNs;
+    }
+    recordScanPhase(PhaseRead, readNs);
+    recordScanPhase(PhaseParse, parseNs);
+    recordScanPhase(PhaseFilter, filterNs);
+    recordScanPhase(PhaseTotal, a - t0);
+
+    ++sc.scans;
+    sc.lastPids = pids.size();
+    sc.lastSyscalls = sc.totalSyscalls() - sysBefore;
+    sc.lastBytes = sc.procBytesRead - bytesBefore;
+    sc.lastAllocations = t_allocCount - allocsBefore;
+    sc.allocations += sc.lastAllocations;
+    sc.allocBytes += t_allocBytes - allocBytesBefore;
+#endif
+    return out;
+}
+
+// Row details for list/watch --cmdline. cmdline, exe and cwd are resolved only
+// for rows about to be printed (after the threshold, the plan and --top), so a
+// host with thousands of processes pays for a handful of reads. Each field is
+// capped at maxLen bytes, and results are cached by pid + starttime: a reused
+// pid misses, a long-lived process is read once per run.
+struct ProcessDetails {
+    std::string cmdline, exe, cwd;
+};
+
+class ProcessDetailsCache {
+public:
+    explicit ProcessDetailsCache(size_t maxLen = 256) : maxLen_(maxLen < 16 ? 16 : maxLen) {}
+
+    const ProcessDetails& get(pid_t pid) {
+        Entry& e = entries_[pid];
+        e.gen = gen_;
+#ifdef __linux__
+        // One stat read decides whether the three reads below can be skipped.
+        char path[64], buf[1024];
+        unsigned long long start = 0;
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+        if (readProcFile(path, buf, sizeof(buf)) > 0) {
+            const char* p = strrchr(buf, ')');
+            for (int field = 0; p && field < 20; ++field) p = strchr(p + 1, ' ');
+            if (p) start = strtoull(p + 1, nullptr, 10);
+        }
+        if (e.valid && e.starttime == start) return e.details;
+        e.valid = true;
+        e.starttime = start;
+
+        std::vector<char> cmd(maxLen_ + 2);
+        snprintf(path, sizeof(path), "/proc/%d/cmdline", (int)pid);
+        ssize_t n = readProcFile(path, cmd.data(), maxLen_ + 2);   // reads at most maxLen + 1
+        size_t len = n > 0 ? (size_t)n : 0;
+        while (len > 0 && cmd[len - 1] == '\0') --len;
+        // Arguments are NUL-separated; newlines and other controls would break the row.
+        for (size_t i = 0; i < len; ++i)
+            if ((unsigned char)cmd[i] < 0x20 || cmd[i] == 0x7f) cmd[i] = ' ';
+        e.details.cmdline = capped(cmd.data(), len);
+        e.details.exe = readLink(pid, "exe");
+        e.details.cwd = readLink(pid, "cwd");
+#endif
+        return e.details;
+    }
+
+    // Drops entries not asked for since the previous sweep (watch calls this
+    // once per scan so exited processes do not accumulate).
+    void sweep() {
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (it->second.gen != gen_) it = entries_.erase(it);
+            else ++it;
+        }
+        ++gen_;
+    }
+
+private:
+    struct Entry {
+        bool valid = false;
+        unsigned long long starttime = 0;
+        unsigned gen = 0;
+        ProcessDetails details;
+    };
+
+    std::string capped(const char* s, size_t len) const {
+        if (len <= maxLen_) return std::string(s, len);
+        return std::string(s, maxLen_ - 3) + "...";
+    }
+
+#ifdef __linux__
+    std::string readLink(pid_t pid, const char* what) const {
+        char path[64];
+        std::vector<char> buf(maxLen_ + 1);
+        snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, what);
+        ++g_scanStats.syscalls[SysReadlink];
+        ssize_t n = readlink(path, buf.data(), buf.size());   // truncates silently: one extra byte tells
+        if (n < 0) return "?";
+        return capped(buf.data(), (size_t)n);
+    }
+#endif
+
+    size_t maxLen_;
+    unsigned gen_ = 0;
+    std::unordered_map<pid_t, Entry> entries_;
+};
+
+// Owner columns for list/watch --owner. User names and container IDs are
+// interned once per run and looked up by hash, so a row costs a stat of
+// /proc/<pid>, one read of its cgroup file and a hash of the path. A uid is
+// resolved through NSS once per run. The uid table is dropped when
+// /etc/passwd's mtime changes (refresh() is called once per scan). A cgroup
+// path is parsed once, and the lookup key is the bytes of the path.
+class OwnerResolver {
+public:
+    OwnerResolver() { refresh(); }
+
+    void refresh() {
+        struct stat st;
+        if (stat("/etc/passwd", &st) != 0) return;
+        if (st.st_mtime != passwdMtime_ || st.st_size != passwdSize_) users_.clear();
+        passwdMtime_ = st.st_mtime;
+        passwdSize_ = st.st_size;
+    }
+
+    // Empty strings stand for "unknown" (process gone, no container).
+    void resolve(pid_t pid, const std::string*& user, const std::string*& container) {
+        user = container = &unknown_;
+        char path[64], buf[2048];
+        struct stat st;
+        snprintf(path, sizeof(path), "/proc/%d", (int)pid);
+        if (stat(path, &st) != 0) return;
+        user = &userName(st.st_uid);
+#ifdef __linux__
+        snprintf(path, sizeof(path), "/proc/%d/cgroup", (int)pid);
+        ssize_t n = readProcFile(path, buf, sizeof(buf));
+        if (n <= 0) return;
+        size_t len = 0;
+        const char* cg = cgroupPathOf(buf, len);   // same path the victim policy matches
+        if (!cg) return;
+        container = &containerOf(cg, len);
+#endif
+    }
+
+private:
+    const std::string* intern(std::string s) { return &*strings_.insert(std::move(s)).first; }
+
+    const std::string& userName(uid_t uid) {
+        auto it = users_.find(uid);
+        if (it != users_.end()) return *it->second;
+        struct passwd pw, *res = nullptr;
+        char buf[1024];
+        std::string name = getpwuid_r(uid, &pw, buf, sizeof(buf), &res) == 0 && res ? res->pw_name
+                                                                                      : std::to_string(uid);
+        const std::string* interned = intern(std::move(name));
+        users_[uid] = interned;
+        return *interned;
+    }
+
+    const std::string& containerOf(const char* path, size_t len) {
+        uint64_t h = 1469598103934665603ULL;   // FNV-1a
+        for (size_t i = 0; i < len; ++i) h = (h ^ (unsigned char)path[i]) * 1099511628211ULL;
+        std::vector<CgroupEntry>& bucket = cgroups_[h];
+        for (const CgroupEntry& e : bucket)
+            if (e.path.size() == len && memcmp(e.path.data(), path, len) == 0) return *e.id;
+        bucket.push_back(CgroupEntry{std::string(path, len), intern(parseContainerId(path, len))});
+        return *bucket.back().id;
+    }
+
+    // Docker, containerd, CRI-O and podman all name the scope or directory
+    // after a 64-hex-digit ID; shown shortened to 12 like `docker ps`.
+    static std::string parseContainerId(const char* path, size_t len) {
+        size_t run = 0;
+        for (size_t i = 0; i < len; ++i) {
+            if (isxdigit((unsigned char)path[i]) && !isupper((unsigned char)path[i])) {
+                if (++run == 64 && (i + 1 == len || !isxdigit((unsigned char)path[i + 1])))
+                    return std::string(path + i + 1 - 64, 12);
+            } else {
+                run = 0;
+            }
+        }
+        return std::string();
+    }
+
+    struct CgroupEntry {
+        std::string path;
+        const std::string* id;
+    };
+
+    std::unordered_set<std::string> strings_;   // node-based: element addresses are stable
+    std::unordered_map<uid_t, const std::string*> users_;
+    std::unordered_map<uint64_t, std::vector<CgroupEntry>> cgroups_;
+    time_t passwdMtime_ = 0;
+    off_t passwdSize_ = 0;
+    const std::string unknown_;
+};
+
+// Optional row columns shared by list, the kill plan and watch.
+struct RowExtras {
+    ProcessDetailsCache* details = nullptr;
+    OwnerResolver* owner = nullptr;
+};
+
+static void printRowExtras(std::ostream& os, const RowExtras& extras, pid_t pid) {
+    if (extras.owner) {
+        const std::string *user, *container;
+        extras.owner->resolve(pid, user, container);
+        os << " user=" << (user->empty() ? "?" : *user) << " container=" << (container->empty() ? "-" : *container);
+    }
+    if (extras.details) {
+        const ProcessDetails& d = extras.details->get(pid);
+        os << " exe=" << d.exe << " cwd=" << d.cwd << " cmdline=\"" << d.cmdline << "\"";
+    }
+}
+
+#ifdef __linux__
+// Non-destructive counterpart of terminateListed: pushes the anonymous
+// memory of a process to swap/zram (MADV_PAGEOUT) or to the inactive list
+// (MADV_COLD) with process_madvise. Needs CAP_SYS_NICE and ptrace access.
+struct PageoutResult {
+    size_t vmas = 0;                 // anonymous mappings advised
+    size_t calls = 0;                // process_madvise calls
+    unsigned long long advisedBytes = 0;
+    unsigned long long rssBeforeKB = 0, rssAfterKB = 0;
+    unsigned long long anonBeforeKB = 0, anonAfterKB = 0;
+    unsigned long long swapBeforeKB = 0, swapAfterKB = 0;
+    int error = 0;                   // errno that stopped the page-out, 0 if none
+};
+
+// VmRSS, RssAnon and VmSwap from /proc/<pid>/status.
+static bool readRssBreakdown(pid_t pid, unsigned long long& rssKB, unsigned long long& anonKB,
+                             unsigned long long& swapKB) {
+    char path[64], buf[4096];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    if (readProcFile(path, buf, sizeof(buf)) <= 0) return false;
+    const char* p;
+    rssKB = (p = strstr(buf, "\nVmRSS:")) ? strtoull(p + 7, nullptr, 10) : 0;
+    anonKB = (p = strstr(buf, "\nRssAnon:")) ? strtoull(p + 9, nullptr, 10) : 0;
+    swapKB = (p = strstr(buf, "\nVmSwap:")) ? strtoull(p + 8, nullptr, 10) : 0;
+    return true;
+}
+
+// Advises n ranges, calling again until all of them are covered: the kernel
+// advises at most MAX_RW_COUNT (about 2 GB) per call and stops at the first
+// range it cannot advise, returning the bytes done so far. iov and n are left
+// at the first range not advised. Returns 0 or the errno that stopped it.
+static int adviseRanges(int pidfd, struct iovec*& iov, size_t& n, int advice, PageoutResult& r) {
+    while (n > 0) {
+        ++r.calls;
+        ssize_t got = sysProcessMadvise(pidfd, iov, n, advice);
+        if (got < 0) return errno;
+        r.advisedBytes += (unsigned long long)got;
+        size_t left = (size_t)got;
+        while (n > 0 && left >= iov->iov_len) { left -= iov->iov_len; ++iov; --n; }
+        if (n == 0) break;
+        if (got == 0) return EINVAL;   // no progress; let the caller skip the range
+        iov->iov_base = (char*)iov->iov_base + left;
+        iov->iov_len -= left;
+    }
+    return 0;
+}
+
+// Advises every anonymous mapping of the process (heap, stacks and unnamed
+// private mappings), up to UIO_MAXIOV ranges per call. Once a batch fails
+// (e.g. at a locked range) the rest of it is retried one range at a time.
+static bool tryPageOutProcess(pid_t pid, int pidfd, int advice, PageoutResult& r) {
+    readRssBreakdown(pid, r.rssBeforeKB, r.anonBeforeKB, r.swapBeforeKB);
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    std::ifstream maps(path);
+    std::vector<struct iovec> iov;
+    std::string line;
+    while (std::getline(maps, line)) {
+        // "start-end perms offset dev inode [path]"
+        unsigned long long start = 0, end = 0, inode = 0;
+        char perms[8] = {};
+        int pathAt = 0;
+        if (sscanf(line.c_str(), "%llx-%llx %7s %*s %*s %llu %n", &start, &end, perms, &inode, &pathAt) < 4) continue;
+        const char* name = line.c_str() + pathAt;
+        bool anon = inode == 0 && (*name == '\0' || strcmp(name, "[heap]") == 0 ||
+                                   strcmp(name, "[stack]") == 0 || strncmp(name, "[anon:", 6) == 0);
+        if (!anon || perms[0] != 'r' || perms[3] != 'p') continue;
+        struct iovec v;
+        v.iov_base = (void*)(uintptr_t)start;
+        v.iov_len = (size_t)(end - start);
+        iov.push_back(v);
+    }
+    r.vmas = iov.size();
+
+    const size_t kBatch = 1024;   // UIO_MAXIOV
+    for (size_t i = 0; i < iov.size() && !r.error; i += kBatch) {
+        struct iovec* v = &iov[i];
+        size_t n = std::min(kBatch, iov.size() - i);
+        int err = adviseRanges(pidfd, v, n, advice, r);
+        if (err == 0) continue;
+        if (err != EINVAL && err != ENOMEM) { r.error = err; break; }
+        for (; n > 0 && !r.error; ++v, --n) {
+            struct iovec* one = v;
+            size_t m = 1;
+            err = adviseRanges(pidfd, one, m, advice, r);
+            if (err != 0 && err != EINVAL && err != ENOMEM) r.error = err;
+        }
+    }
+    readRssBreakdown(pid, r.rssAfterKB, r.anonAfterKB, r.swapAfterKB);
+    return r.error == 0;
+}
+#endif
+
+struct TerminationVictim {
+    pid_t pid = 0;
+    int pidfd = -1;             // borrowed from a PidfdTable; -1 = signal by pid
+    std::string name;
+    size_t rss = 0;
+    enum Outcome { Pending, Exited, Killed, SignalFailed, Survived } outcome = Pending;
+    int error = 0;              // errno of the failed signal
+    double exitMs = -1;         // since SIGTERM was sent; -1 if never seen exiting
+    bool mreleased = false;     // address space reaped with process_mrelease
+};
+
+// Outcome of a batch beyond the per-victim results.
+struct TerminationSummary {
+    unsigned long long availBeforeKB = 0;   // MemAvailable before SIGTERM
+    unsigned long long availAfterKB = 0;    // once it stopped rising
+    double recoveredMs = 0;                 // SIGTERM to the last rise of MemAvailable
+    bool mreleaseMissing = false;           // kernel without process_mrelease
+};
+
+static int sendSignal(const TerminationVictim& v, int sig) {
+#ifdef __linux__
+    if (v.pidfd >= 0) return sysPidfdSendSignal(v.pidfd, sig);
+#endif
+    return kill(v.pid, sig);
+}
+
+#ifdef __linux__
+// Termination engine. Every victim gets SIGTERM up front and their pidfds
+// (readable once the process exits) share one epoll set, so a batch of any
+// size waits a single grace period before the survivors get SIGKILL. Victims
+// without a pidfd are polled with kill(pid, 0) every 20 ms.
+//
+// Right after SIGKILL each survivor's memory is reaped with process_mrelease,
+// so it comes back even if the victim is stuck in its exit path. Afterwards
+// MemAvailable is sampled until it stops rising to measure the recovery.
+static void terminateAll(std::vector<TerminationVictim>& victims, unsigned graceMs, unsigned killWaitMs,
+                         TerminationSummary& sum) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    sum.availBeforeKB = readMemAvailableKB();
+    uint64_t t0 = monotonicNs();
+    size_t pending = 0, polled = 0;
+    for (size_t i = 0; i < victims.size(); ++i) {
+        TerminationVictim& v = victims[i];
+        if (sendSignal(v, SIGTERM) != 0) {
+            if (errno == ESRCH) { v.outcome = TerminationVictim::Exited; v.exitMs = 0; }
+            else { v.outcome = TerminationVictim::SignalFailed; v.error = errno; }
+            continue;
+        }
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        if (v.pidfd < 0 || ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, v.pidfd, &ev) != 0) {
+            v.pidfd = -1;
+            ++polled;
+        }
+        ++pending;
+    }
+
+    bool killed = false;
+    uint64_t deadline = t0 + (uint64_t)graceMs * 1000000ULL;
+    struct epoll_event events[64];
+    while (pending > 0) {
+        uint64_t now = monotonicNs();
+        if (now >= deadline) {
+            if (killed) break;
+            for (auto &v : victims) {
+                if (v.outcome == TerminationVictim::Pending) sendSignal(v, SIGKILL);
+            }
+            // Signal everyone first: mrelease runs synchronously per victim.
+            static bool mreleaseSupported = true;
+            for (auto &v : victims) {
+                if (v.outcome != TerminationVictim::Pending || v.pidfd < 0 || !mreleaseSupported) continue;
+                if (sysProcessMrelease(v.pidfd) == 0) v.mreleased = true;
+                else if (errno == ENOSYS) mreleaseSupported = false;
+            }
+            sum.mreleaseMissing = !mreleaseSupported;
+            killed = true;
+            deadline = now + (uint64_t)killWaitMs * 1000000ULL;
+            continue;
+        }
+        int timeout = (int)((deadline - now + 999999) / 1000000);
+        if (polled > 0) timeout = std::min(timeout, 20);
+        int n = 0;
+        if (ep >= 0) {
+            n = epoll_wait(ep, events, 64, timeout);
+        } else {
+            struct timespec ts = {0, timeout * 1000000L};   // everything is polled, timeout <= 20
+            nanosleep(&ts, nullptr);
+        }
+        now = monotonicNs();
+        TerminationVictim::Outcome done = killed ? TerminationVictim::Killed : TerminationVictim::Exited;
+        for (int k = 0; k < n; ++k) {
+            TerminationVictim& v = victims[events[k].data.u64];
+            epoll_ctl(ep, EPOLL_CTL_DEL, v.pidfd, nullptr);
+            v.outcome = done;
+            v.exitMs = (now - t0) / 1e6;
+            --pending;
+        }
+        if (polled == 0) continue;
+        for (auto &v : victims) {
+            if (v.outcome != TerminationVictim::Pending || v.pidfd >= 0) continue;
+            if (kill(v.pid, 0) != 0 && errno == ESRCH) {
+                v.outcome = done;
+                v.exitMs = (now - t0) / 1e6;
+                --pending;
+                --polled;
+            }
+        }
+    }
+    for (auto &v : victims) {
+        if (v.outcome == TerminationVictim::Pending) v.outcome = TerminationVictim::Survived;
+    }
+    if (ep >= 0) close(ep);
+
+    // The last exit is not the end of reclaim: sample every 10 ms until
+    // MemAvailable has not grown by 1 MB for 50 ms (at most one second).
+    unsigned long long best = readMemAvailableKB();
+    uint64_t bestAt = monotonicNs(), end = bestAt + 1000000000ULL;
+    for (uint64_t now = bestAt; now < end && now - bestAt < 50000000ULL; now = monotonicNs()) {
+        struct timespec ts = {0, 10000000L};
+        nanosleep(&ts, nullptr);
+        unsigned long long a = readMemAvailableKB();
+        if (a >= best + 1024) { best = a; bestAt = monotonicNs(); }
+    }
+    sum.availAfterKB = best;
+    sum.recoveredMs = (bestAt - t0) / 1e6;
+}
+#endif
+
+// Parses one victim policy option at argv[i] (advancing i past its value).
+// Returns false if argv[i] is not a policy option.
+static bool parsePolicyOption(int argc, char** argv, int& i, VictimPolicy& p) {
+    std::string a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (a == "--protect" && hasValue) {
+        std::stringstream ss(argv[++i]);
+        std::string name;
+        while (std::getline(ss, name, ',')) if (!name.empty()) p.protectedComms.push_back(name);
+    }
+    else if (a == "--allow-root") p.allowRoot = true;
+    else if (a == "--uid" && hasValue) p.onlyUid = std::stoll(argv[++i]);
+    else if (a == "--cgroup" && hasValue) p.cgroups.push_back(argv[++i]);
+    else if (a == "--protect-cgroup" && hasValue) p.protectedCgroups.push_back(argv[++i]);
+    else if (a == "--pss") p.usePss = true;
+    else if (a == "--min-age" && hasValue) p.minAgeSec = std::stoul(argv[++i]);
+    else if (a == "--age-weight" && hasValue) p.ageWeightPerDay = std::stod(argv[++i]);
+    else return false;
+    return true;
+}
+
+// Prints the kill plan (victims in kill order, then the skipped candidates
+// with the rule that spared them) and returns the victims as list rows.
+static ProcessList printKillPlan(const KillPlan& plan, const RowExtras& extras = RowExtras()) {
+    ProcessList rows;
+    char score[32];
+    for (auto &c : plan.victims()) {
+        snprintf(score, sizeof(score), "%.1f", c.score);
+        std::cout << "PID=" << c.pid << " name=" << c.name << " rssMB=" << (c.rss / 1024 / 1024);
+        if (c.pss) std::cout << " pssMB=" << (c.pss / 1024 / 1024);
+        std::cout << " oom_score=" << c.oomScore << " ageS=" << (long long)c.ageSec << " score=" << score;
+        printRowExtras(std::cout, extras, c.pid);
+        std::cout << "\n";
+        rows.push_back(makeProcessRecord(c.pid, c.name, c.rss));
+    }
+    for (auto &c : plan.skipped()) {
+        std::cout << "  skipped PID=" << c.pid << " name=" << c.name << " rssMB=" << (c.rss / 1024 / 1024)
+                  << " (" << c.skipReason << ")";
+        printRowExtras(std::cout, extras, c.pid);
+        std::cout << "\n";
+    }
+    return rows;
+}
+
+// Terminates the listed processes and prints one line per victim. On Linux the
+// batch goes through terminateAll; elsewhere each process gets SIGTERM only.
+static TerminationSummary terminateListed(const ProcessList& procs, const PidfdTable& handles, unsigned graceMs) {
+    TerminationSummary sum;
+    if (procs.empty()) return sum;
+    std::vector<TerminationVictim> victims(procs.size());
+    for (size_t i = 0; i < procs.size(); ++i) {
+        victims[i].pid = procs[i].pid;
+        victims[i].name = procs[i].name();
+        victims[i].rss = procs[i].rss();
+        victims[i].pidfd = handles.get(victims[i].pid);
+    }
+#ifdef __linux__
+    std::cout << "Terminating " << victims.size() << " processes (grace " << graceMs << " ms) ...\n";
+    uint64_t t0 = monotonicNs();
+    terminateAll(victims, graceMs, 2000, sum);
+    double totalMs = (monotonicNs() - t0) / 1e6;
+#else
+    (void)graceMs;
+    for (auto &v : victims) {
+        if (sendSignal(v, SIGTERM) != 0) { v.outcome = TerminationVictim::SignalFailed; v.error = errno; }
+    }
+#endif
+    size_t exited = 0, failed = 0, survived = 0;
+    char ms[32];
+    for (auto &v : victims) {
+        std::cout << "  PID=" << v.pid << " name=" << v.name << " ";
+        snprintf(ms, sizeof(ms), "%.1f", v.exitMs);
+        switch (v.outcome) {
+        case TerminationVictim::Exited: std::cout << "exited after " << ms << " ms (SIGTERM)\n"; ++exited; break;
+        case TerminationVictim::Killed:
+            std::cout << "exited after " << ms << " ms (SIGKILL" << (v.mreleased ? ", mreleased" : "") << ")\n";
+            ++exited;
+            break;
+        case TerminationVictim::SignalFailed: std::cout << "FAILED: " << strerror(v.error) << "\n"; ++failed; break;
+        case TerminationVictim::Survived: std::cout << "still running after SIGKILL\n"; ++survived; break;
+        default: std::cout << "SIGTERM sent\n"; break;
+        }
+    }
+#ifdef __linux__
+    snprintf(ms, sizeof(ms), "%.1f", totalMs);
+    std::cout << "Done in " << ms << " ms: " << exited << " exited, " << failed << " failed, "
+              << survived << " still running\n";
+    long long gainedMB = ((long long)sum.availAfterKB - (long long)sum.availBeforeKB) / 1024;
+    snprintf(ms, sizeof(ms), "%.1f", sum.recoveredMs);
+    std::cout << "MemAvailable " << (gainedMB >= 0 ? "+" : "") << gainedMB << " MB, settled " << ms
+              << " ms after SIGTERM\n";
+    if (sum.mreleaseMissing) std::cout << "process_mrelease not supported by this kernel; waited for exits instead\n";
+#endif
+    return sum;
+}
+
+#endif
+
+// trim --arenas: targeted trim of the arenas with the most free memory under
+// a pause budget (ex1::trimArenas), reported as pause time against bytes.
+int trimArenasOfCurrentProcess(const ex1::ArenaTrimOptions& opts) {
+    ex1::ArenaTrimResult r;
+    if (!ex1::trimArenas(opts, r)) {
+        std::cout << "Targeted trim not available on this platform.\n";
+        return 1;
+    }
+    std::cout << "Allocator: " << r.allocator << ", top " << opts.maxArenas << " arenas, budget " << opts.budgetMs
+              << " ms, min free " << opts.minFreeKB << " KB\n";
+    std::cout << "arena     freeKB  releasedKB   pauseMs\n";
+    for (const ex1::ArenaTrimEntry& e : r.arenas) {
+        char nr[16], line[96];
+        if (e.arena == ex1::kAllArenas) snprintf(nr, sizeof(nr), "all");
+        else snprintf(nr, sizeof(nr), "%d", e.arena);
+        snprintf(line, sizeof(line), "%5s %10llu %11llu %9.3f%s\n", nr, (unsigned long long)e.freeKB,
+                 (unsigned long long)e.releasedKB, e.pauseMs, e.trimmed ? "" : "  (not trimmed)");
+        std::cout << line;
+    }
+    if (r.predictedMs >= 0) std::cout << "Predicted pause: " << r.predictedMs << " ms\n";
+    if (r.skipped) std::cout << "Not trimmed: " << r.skipped << "\n";
+    std::cout << "Released " << r.releasedKB << " KB in " << r.pauseMs << " ms of pause";
+    if (r.pauseMs > 0) std::cout << " (" << (unsigned long long)(r.releasedKB / r.pauseMs) << " KB/ms)";
+    std::cout << "\n";
+    return 0;
+}
+
+#ifdef __linux__
+// ---------------------------------------------------------------------------
+// watch mode: periodic rescans with an adaptive interval.
+//
+// The scheduler shortens the interval when MemAvailable drops, when PSI memory
+// pressure rises or when processes are being forked quickly, and backs off
+// while the system is calm. Independently of that, the scan cost (CPU time of
+// the scanning thread, which includes the kernel time spent generating /proc
+// files) is kept under a budget expressed as a percentage of one core.
+// ---------------------------------------------------------------------------
+
+struct PressureSample {
+    unsigned long long memTotalKB = 0;
+    unsigned long long memAvailableKB = 0;
+    double psiSomeAvg10 = -1.0;          // -1 when /proc/pressure/memory is missing
+    double psiFullAvg10 = -1.0;
+    unsigned long long forksTotal = 0;   // "processes" counter from /proc/stat
+};
+
+static void readPressureSample(PressureSample& s) {
+    std::ifstream mi("/proc/meminfo");
+    std::string key; unsigned long long val = 0; std::string unit;
+    int found = 0;
+    while (found < 2 && mi >> key >> val) {
+        std::getline(mi, unit);
+        if (key == "MemTotal:") { s.memTotalKB = val; ++found; }
+        else if (key == "MemAvailable:") { s.memAvailableKB = val; ++found; }
+    }
+
+    std::ifstream psi("/proc/pressure/memory");
+    std::string line;
+    while (std::getline(psi, line)) {
+        // "some avg10=0.12 avg60=... total=..."
+        size_t p = line.find("avg10=");
+        if (p == std::string::npos) continue;
+        double v = std::strtod(line.c_str() + p + 6, nullptr);
+        if (line.compare(0, 4, "some") == 0) s.psiSomeAvg10 = v;
+        else if (line.compare(0, 4, "full") == 0) s.psiFullAvg10 = v;
+    }
+
+    std::ifstream st("/proc/stat");
+    while (std::getline(st, line)) {
+        if (line.compare(0, 10, "processes ") == 0) {
+            s.forksTotal = std::strtoull(line.c_str() + 10, nullptr, 10);
+            break;
+        }
+    }
+}
+
+static double monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// CPU time of the calling thread only, so in serve the HTTP thread's work
+// (scrape load) is not charged to the scanner's budget.
+static double threadCpuMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+struct WatchOptions {
+    size_t thresholdMB = 0;
+    unsigned baseIntervalMs = 1000;  // interval under mild pressure
+    unsigned minIntervalMs = 100;    // floor during incidents
+    unsigned maxIntervalMs = 10000;  // ceiling while calm
+    double cpuBudgetPct = 5.0;       // scan CPU as % of one core, <= 0 disables
+    double churnHighPerSec = 200.0;  // fork rate treated as maximum urgency
+    unsigned long maxScans = 0;      // 0 = until interrupted
+    bool deltaOnly = false;          // emit only appeared/disappeared/changed rows
+    size_t epsilonMB = 16;           // minimum RSS change reported in delta mode
+    std::string recordPath;          // history file to append to (empty = off)
+    size_t cgroupReclaimMB = 0;      // per cgroup per round, 0 = no proactive cgroup reclaim
+    size_t cgroupTop = 3;            // coldest leaf cgroups reclaimed from per round
+    unsigned cgroupEverySec = 10;    // minimum time between rounds
+    double cgroupPsiMax = 1.0;       // skip cgroups whose memory PSI some avg10 is above this
+    bool showDetails = false;        // cmdline/exe/cwd per printed row (full mode only)
+    bool showOwner = false;          // user and container per printed row (full mode only)
+    std::vector<SortKey> sortKeys{SortRss};   // row order; growth is against the previous scan
+    size_t detailMaxLen = 256;
+};
+
+class AdaptiveScheduler {
+public:
+    explicit AdaptiveScheduler(const WatchOptions& o) : opts_(o), intervalMs_(o.baseIntervalMs) {}
+
+    // Urgency in [0,1] from the strongest of the three signals.
+    double urgency(const PressureSample& p, double forksPerSec) const {
+        double u = 0.0;
+        if (p.memTotalKB > 0) {
+            // 50% available or more is calm, 5% or less is an incident
+            double ratio = (double)p.memAvailableKB / (double)p.memTotalKB;
+            u = std::max(u, clamp01((0.50 - ratio) / 0.45));
+        }
+        if (p.psiSomeAvg10 >= 0) {
+            // PSI is a percentage of wall time stalled; 1% starts to matter, 20% is severe
+            u = std::max(u, clamp01((p.psiSomeAvg10 - 1.0) / 19.0));
+        }
+        if (p.psiFullAvg10 > 0) {
+            u = std::max(u, clamp01(p.psiFullAvg10 / 5.0));
+        }
+        if (opts_.churnHighPerSec > 0) {
+            u = std::max(u, clamp01(forksPerSec / opts_.churnHighPerSec));
+        }
+        return u;
+    }
+
+    // Called after every scan; returns the time to sleep before the next one.
+    unsigned next(double u, double scanCpuMs, double scanWallMs) {
+        if (u > 0.05) {
+            // React immediately: interpolate between base and min by urgency.
+            intervalMs_ = opts_.baseIntervalMs - (opts_.baseIntervalMs - opts_.minIntervalMs) * u;
+        } else {
+            // Calm: relax gradually so a short lull does not blind us.
+            intervalMs_ = std::max(intervalMs_, (double)opts_.baseIntervalMs) * 1.5;
+        }
+        intervalMs_ = std::min(std::max(intervalMs_, (double)opts_.minIntervalMs), (double)opts_.maxIntervalMs);
+
+        // Smooth the scan cost so one slow scan (e.g. cold dentry cache) does not
+        // stretch the schedule for long.
+        cpuEwmaMs_ = (cpuEwmaMs_ < 0) ? scanCpuMs : 0.7 * cpuEwmaMs_ + 0.3 * scanCpuMs;
+
+        double sleepMs = intervalMs_;
+        budgetLimited_ = false;
+        if (opts_.cpuBudgetPct > 0) {
+            // cpu / (wall + sleep) <= budget  =>  sleep >= cpu / budget - wall
+            double minSleep = cpuEwmaMs_ * 100.0 / opts_.cpuBudgetPct - scanWallMs;
+            if (minSleep > sleepMs) { sleepMs = minSleep; budgetLimited_ = true; }
+        }
+        return (unsigned)(sleepMs + 0.5);
+    }
+
+    bool budgetLimited() const { return budgetLimited_; }
+
+private:
+    static double clamp01(double v) { return v < 0 ? 0 : (v > 1 ? 1 : v); }
+
+    WatchOptions opts_;
+    double intervalMs_;
+    double cpuEwmaMs_ = -1.0;
+    bool budgetLimited_ = false;
+};
+
+// Delta stream between consecutive scans. State lives in a flat table indexed
+// by pid (pids are small dense integers bounded by kernel.pid_max), so each
+// scan costs O(rows) lookups with no sorting or hashing. A generation counter
+// marks the rows seen in the current scan; the previous scan's pid list is
+// walked once to find rows that disappeared.
+class SnapshotDiff {
+public:
+    explicit SnapshotDiff(size_t epsilonBytes) : epsilon_(epsilonBytes) {}
+
+    // Appends "+", "-" and "~" records to out; returns the number of records.
+    size_t update(const ProcessList& procs, std::string& out) {
+        ++gen_;
+        size_t records = 0;
+        current_.clear();
+        for (auto &t : procs) {
+            pid_t pid = t.pid;
+            const char* name = t.comm;
+            size_t rss = t.rss();
+            if ((size_t)pid >= slots_.size()) slots_.resize((size_t)pid + 1024);
+            Slot& sl = slots_[pid];
+            current_.push_back(pid);
+            if (sl.gen != gen_ - 1 || memcmp(sl.name, name, sizeof(sl.name)) != 0) {
+                // New pid, or the pid was reused by a different command.
+                if (sl.gen == gen_ - 1) { emit(out, '-', pid, sl.name, sl.reportedRss, 0); ++records; }
+                memcpy(sl.name, name, sizeof(sl.name));
+                sl.reportedRss = rss;
+                emit(out, '+', pid, name, rss, 0);
+                ++records;
+            } else {
+                size_t d = rss > sl.reportedRss ? rss - sl.reportedRss : sl.reportedRss - rss;
+                if (d >= epsilon_) {
+                    emit(out, '~', pid, name, rss, (long long)rss - (long long)sl.reportedRss);
+                    sl.reportedRss = rss;
+                    ++records;
+                }
+            }
+            sl.gen = gen_;
+        }
+        for (pid_t pid : previous_) {
+            Slot& sl = slots_[pid];
+            if (sl.gen == gen_ - 1) {
+                emit(out, '-', pid, sl.name, sl.reportedRss, 0);
+                sl.name[0] = '\0';
+                ++records;
+            }
+        }
+        previous_.swap(current_);
+        return records;
+    }
+
+private:
+    struct Slot {
+        unsigned gen = 0;           // scan in which this pid was last above threshold
+        size_t reportedRss = 0;     // value last emitted; drift accumulates until epsilon
+        char name[16] = {};         // ProcessRecord::comm
+    };
+
+    static void emit(std::string& out, char kind, pid_t pid, const char* name, size_t rss, long long delta) {
+        out += kind;
+        out += " PID=" + std::to_string(pid) + " name=";
+        out += name;
+        out += " rssMB=" + std::to_string(rss / 1024 / 1024);
+        if (kind == '~') {
+            out += " deltaMB=";
+            if (delta > 0) out += '+';
+            out += std::to_string(delta / 1024 / 1024);
+        }
+        out += '\n';
+    }
+
+    size_t epsilon_;
+    unsigned gen_ = 1;
+    std::vector<Slot> slots_;
+    std::vector<pid_t> previous_, current_;
+};
+
+// ---------------------------------------------------------------------------
+// Proactive cgroup reclaim (cgroup-reclaim / watch --cgroup-reclaim).
+//
+// Writing N to a cgroup v2 memory.reclaim file makes the kernel reclaim N
+// bytes from that cgroup alone, without killing anything; EAGAIN means it
+// could not find enough reclaimable memory. Requests are split into steps
+// with optional pauses so a large reclaim does not stall the workload in one
+// go. In watch mode the leaf cgroups with the most inactive (cold) memory are
+// reclaimed from periodically, skipping any whose own memory PSI shows that
+// it is already stalling.
+// ---------------------------------------------------------------------------
+
+static const std::string& cgroupRoot() {
+    static const std::string root = []() {
+        struct stat st;
+        if (stat("/sys/fs/cgroup/cgroup.controllers", &st) == 0) return std::string("/sys/fs/cgroup");
+        if (stat("/sys/fs/cgroup/unified/cgroup.controllers", &st) == 0) return std::string("/sys/fs/cgroup/unified");
+        return std::string("/sys/fs/cgroup");
+    }();
+    return root;
+}
+
+// Accepts a path below the cgroup root ("/system.slice/x.service") or an
+// absolute path into the cgroup filesystem.
+static std::string cgroupDir(const std::string& path) {
+    if (path.compare(0, 15, "/sys/fs/cgroup/") == 0 || path == "/sys/fs/cgroup") return path;
+    return cgroupRoot() + (path.empty() || path[0] != '/' ? "/" : "") + path;
+}
+
+static bool readCgroupValue(const std::string& file, unsigned long long& v) {
+    std::ifstream in(file);
+    return (bool)(in >> v);
+}
+
+// Inactive anon + file bytes from memory.stat.
+static unsigned long long cgroupColdBytes(const std::string& dir) {
+    std::ifstream in(dir + "/memory.stat");
+    std::string key;
+    unsigned long long v = 0, cold = 0;
+    while (in >> key >> v) {
+        if (key == "inactive_anon" || key == "inactive_file") cold += v;
+    }
+    return cold;
+}
+
+static double cgroupPsiSomeAvg10(const std::string& dir) {
+    std::ifstream in(dir + "/memory.pressure");
+    std::string line;
+    if (!std::getline(in, line)) return 0;
+    size_t p = line.find("avg10=");
+    return p == std::string::npos ? 0 : std::strtod(line.c_str() + p + 6, nullptr);
+}
+
+struct CgroupReclaimResult {
+    unsigned long long requested = 0;
+    unsigned long long accepted = 0;       // sum of the steps the kernel completed
+    unsigned long long currentBefore = 0;  // memory.current
+    unsigned long long currentAfter = 0;
+    unsigned steps = 0;
+    double ms = 0;                         // wall time, pauses excluded
+    int error = 0;                         // EAGAIN: not enough reclaimable memory
+};
+
+static bool cgroupReclaim(const std::string& dir, unsigned long long bytes, unsigned long long stepBytes,
+                          unsigned pauseMs, CgroupReclaimResult& r) {
+    r.requested = bytes;
+    readCgroupValue(dir + "/memory.current", r.currentBefore);
+    int fd = open((dir + "/memory.reclaim").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        r.error = errno;
+        return false;
+    }
+    if (stepBytes == 0) stepBytes = bytes;
+    while (r.accepted < bytes) {
+        unsigned long long step = std::min(stepBytes, bytes - r.accepted);
+        std::string s = std::to_string(step);
+        uint64_t t0 = monotonicNs();
+        ssize_t w = write(fd, s.data(), s.size());
+        r.ms += (monotonicNs() - t0) / 1e6;
+        ++r.steps;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            r.error = errno;
+            break;
+        }
+        r.accepted += step;
+        if (pauseMs > 0 && r.accepted < bytes) {
+            struct timespec ts = {(time_t)(pauseMs / 1000), (long)(pauseMs % 1000) * 1000000L};
+            nanosleep(&ts, nullptr);
+        }
+    }
+    close(fd);
+    readCgroupValue(dir + "/memory.current", r.currentAfter);
+    return r.error == 0;
+}
+
+struct ColdCgroup {
+    std::string dir;
+    unsigned long long coldBytes;
+};
+
+// Leaf cgroups that support memory.reclaim, by descending cold memory.
+static void findColdCgroups(const std::string& dir, int depth, std::vector<ColdCgroup>& out) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    bool leaf = true;
+    struct dirent* e;
+    while ((e = readdir(d)) != nullptr) {
+        if (e->d_type != DT_DIR || e->d_name[0] == '.') continue;
+        leaf = false;
+        if (depth < 8) findColdCgroups(dir + "/" + e->d_name, depth + 1, out);
+    }
+    closedir(d);
+    struct stat st;
+    if (leaf && depth > 0 && stat((dir + "/memory.reclaim").c_str(), &st) == 0) {
+        out.push_back(ColdCgroup{dir, cgroupColdBytes(dir)});
+    }
+    if (depth == 0) {
+        std::sort(out.begin(), out.end(),
+                  [](const ColdCgroup& a, const ColdCgroup& b) { return a.coldBytes > b.coldBytes; });
+    }
+}
+
+static void printCgroupReclaim(std::ostream& os, const std::string& dir, const CgroupReclaimResult& r) {
+    char ms[32];
+    snprintf(ms, sizeof(ms), "%.1f", r.ms);
+    long long freed = (long long)r.currentBefore - (long long)r.currentAfter;
+    os << "cgroup=" << dir << " requestedMB=" << r.requested / 1024 / 1024
+       << " reclaimedMB=" << r.accepted / 1024 / 1024
+       << " currentMB=" << r.currentBefore / 1024 / 1024 << "->" << r.currentAfter / 1024 / 1024
+       << " (" << (freed >= 0 ? "-" : "+") << (freed >= 0 ? freed : -freed) / 1024 / 1024 << ")"
+       << " steps=" << r.steps << " ms=" << ms;
+    if (r.error == EAGAIN) os << " (not enough reclaimable memory)";
+    else if (r.error) os << " FAILED: " << strerror(r.error);
+    os << "\n";
+}
+
+struct CgroupReclaimOptions {
+    std::string path;
+    size_t mb = 0;
+    size_t stepMB = 64;
+    unsigned pauseMs = 0;
+};
+
+int runCgroupReclaim(const CgroupReclaimOptions& o) {
+    std::string dir = cgroupDir(o.path);
+    CgroupReclaimResult r;
+    bool ok = cgroupReclaim(dir, o.mb * 1024ULL * 1024ULL, o.stepMB * 1024ULL * 1024ULL, o.pauseMs, r);
+    if (r.error == ENOENT) {
+        std::cerr << dir << "/memory.reclaim not found (needs the cgroup v2 memory controller, Linux 5.19+)\n";
+        return 1;
+    }
+    printCgroupReclaim(std::cout, dir, r);
+    return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// History file (watch --record / query).
+//
+// Layout, all integers little-endian:
+//   file header  "EX1HIST\0" u32 version u32 reserved                (16 bytes)
+//   block*       "HBLK" u32 payloadBytes u32 rows u32 pidMin u32 pidMax
+//                u32 reserved i64 tMinMs i64 tMaxMs                   (40 bytes)
+//                payload
+//   index        "HIDX" u32 count, count x (u64 offset i64 tMin i64 tMax
+//                u32 pidMin u32 pidMax u32 rows u32 payloadBytes)
+//   trailer      u64 indexOffset "EX1HEND\0"                          (16 bytes)
+//
+// A block payload holds the comm dictionary followed by four varint columns,
+// each prefixed by its byte length: time (delta vs previous row), pid (zigzag
+// delta vs previous row), rssKB (zigzag delta vs the same pid's previous value
+// in the block) and comm (dictionary index). Queries use the index (or the
+// block headers if the file was not closed cleanly) to skip blocks by time
+// range, pid range or dictionary before decoding anything.
+// ---------------------------------------------------------------------------
+
+static const char kHistMagic[8] = {'E','X','1','H','I','S','T','\0'};
+static const char kHistEnd[8]   = {'E','X','1','H','E','N','D','\0'};
+static const size_t kHistFileHeader = 16;
+static const size_t kHistBlockHeader = 40;
+static const size_t kHistIndexEntry = 40;
+
+static void putU32(std::string& b, uint32_t v) { for (int i = 0; i < 4; ++i) b += (char)(v >> (8 * i)); }
+static void putU64(std::string& b, uint64_t v) { for (int i = 0; i < 8; ++i) b += (char)(v >> (8 * i)); }
+static uint32_t getU32(const unsigned char* p) {
+    uint32_t v = 0; for (int i = 0; i < 4; ++i) v |= (uint32_t)p[i] << (8 * i); return v;
+}
+static uint64_t getU64(const unsigned char* p) {
+    uint64_t v = 0; for (int i = 0; i < 8; ++i) v |= (uint64_t)p[i] << (8 * i); return v;
+}
+static void putVarint(std::string& b, uint64_t v) {
+    while (v >= 0x80) { b += (char)(v | 0x80); v >>= 7; }
+    b += (char)v;
+}
+static bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char c = *p++;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+static bool writeAll(int fd, const std::string& b) {
+    const char* p = b.data();
+    size_t left = b.size();
+    while (left > 0) {
+        ssize_t w = write(fd, p, left);
+        if (w < 0) { if (errno == EINTR) continue; return false; }
+        p += w; left -= (size_t)w;
+    }
+    return true;
+}
+static bool preadAll(int fd, void* buf, size_t n, off_t off) {
+    char* p = (char*)buf;
+    while (n > 0) {
+        ssize_t r = pread(fd, p, n, off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r; n -= (size_t)r; off += r;
+    }
+    return true;
+}
+
+struct HistoryBlockInfo {
+    uint64_t offset = 0;      // of the block header
+    int64_t tMin = 0, tMax = 0;
+    uint32_t pidMin = 0, pidMax = 0;
+    uint32_t rows = 0;
+    uint32_t payloadBytes = 0;
+};
+
+struct HistoryRow {
+    int64_t timeMs;
+    uint32_t pid;
+    uint64_t rssKB;
+    uint32_t comm;            // index into the block dictionary
+};
+
+// A block read from a file must lie inside the data area and hold at least
+// the four varint bytes per row that its row count promises; anything else is
+// a torn or foreign file, not something to allocate or decode.
+static bool historyBlockFits(const HistoryBlockInfo& b, uint64_t dataEnd) {
+    return b.offset >= kHistFileHeader && b.offset <= dataEnd &&
+           kHistBlockHeader + (uint64_t)b.payloadBytes <= dataEnd - b.offset &&
+           (uint64_t)b.rows * 4 <= b.payloadBytes;
+}
+
+// Loads the block index of an open history file. Uses the trailer index when
+// present and consistent; otherwise walks the block headers. dataEnd receives
+// the end of the last complete block (where appending should resume).
+static bool loadHistoryIndex(int fd, std::vector<HistoryBlockInfo>& blocks, uint64_t& dataEnd) {
+    blocks.clear();
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    uint64_t size = (uint64_t)st.st_size;
+    unsigned char hdr[kHistFileHeader];
+    if (size < kHistFileHeader || !preadAll(fd, hdr, kHistFileHeader, 0) || memcmp(hdr, kHistMagic, 8) != 0)
+        return false;
+
+    unsigned char tr[16];
+    if (size >= kHistFileHeader + 16 && preadAll(fd, tr, 16, (off_t)(size - 16)) && memcmp(tr + 8, kHistEnd, 8) == 0) {
+        uint64_t idxOff = getU64(tr);
+        unsigned char ih[8];
+        if (idxOff <= size - 24 && preadAll(fd, ih, 8, (off_t)idxOff) && memcmp(ih, "HIDX", 4) == 0) {
+            uint32_t count = getU32(ih + 4);
+            if (idxOff + 8 + (uint64_t)count * kHistIndexEntry == size - 16) {
+                std::vector<unsigned char> buf((size_t)count * kHistIndexEntry);
+                bool ok = count == 0 || preadAll(fd, buf.data(), buf.size(), (off_t)(idxOff + 8));
+                for (uint32_t i = 0; ok && i < count; ++i) {
+                    const unsigned char* e = buf.data() + (size_t)i * kHistIndexEntry;
+                    HistoryBlockInfo b;
+                    b.offset = getU64(e);
+                    b.tMin = (int64_t)getU64(e + 8);
+                    b.tMax = (int64_t)getU64(e + 16);
+                    b.pidMin = getU32(e + 24);
+                    b.pidMax = getU32(e + 28);
+                    b.rows = getU32(e + 32);
+                    b.payloadBytes = getU32(e + 36);
+                    ok = historyBlockFits(b, idxOff);
+                    blocks.push_back(b);
+                }
+                if (ok) {
+                    dataEnd = idxOff;
+                    return true;
+                }
+                blocks.clear();
+            }
+        }
+    }
+
+    // No usable index (e.g. the recorder was killed): walk the headers and
+    // stop at the first torn or foreign block.
+    uint64_t off = kHistFileHeader;
+    unsigned char bh[kHistBlockHeader];
+    while (off + kHistBlockHeader <= size && preadAll(fd, bh, kHistBlockHeader, (off_t)off)) {
+        if (memcmp(bh, "HBLK", 4) != 0) break;
+        HistoryBlockInfo b;
+        b.offset = off;
+        b.payloadBytes = getU32(bh + 4);
+        b.rows = getU32(bh + 8);
+        b.pidMin = getU32(bh + 12);
+        b.pidMax = getU32(bh + 16);
+        b.tMin = (int64_t)getU64(bh + 24);
+        b.tMax = (int64_t)getU64(bh + 32);
+        if (!historyBlockFits(b, size)) break;
+        blocks.push_back(b);
+        off += kHistBlockHeader + b.payloadBytes;
+    }
+    dataEnd = off;
+    return true;
+}
+
+class HistoryWriter {
+public:
+    ~HistoryWriter() { close(); }
+
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (fstat(fd_, &st) != 0) return fail();
+        uint64_t end = 0;
+        if (st.st_size == 0) {
+            std::string h(kHistMagic, 8);
+            putU32(h, 1);
+            putU32(h, 0);
+            if (!writeAll(fd_, h)) return fail();
+            end = kHistFileHeader;
+        } else if (!loadHistoryIndex(fd_, blocks_, end)) {
+            std::cerr << "Not a history file: " << path << "\n";
+            return fail();
+        }
+        // Drop the old index/trailer (or a torn block); it is rewritten on close.
+        if (ftruncate(fd_, (off_t)end) != 0 || lseek(fd_, (off_t)end, SEEK_SET) < 0) return fail();
+        end_ = end;
+        return true;
+    }
+
+    void append(int64_t timeMs, const ProcessList& procs) {
+        if (fd_ < 0) return;
+        for (auto &t : procs) {
+            std::string name = t.name();
+            auto it = dictIndex_.find(name);
+            uint32_t ci;
+            if (it == dictIndex_.end()) {
+                ci = (uint32_t)dict_.size();
+                dict_.push_back(name);
+                dictIndex_.emplace(name, ci);
+            } else {
+                ci = it->second;
+            }
+            rows_.push_back(HistoryRow{timeMs, (uint32_t)t.pid, (uint64_t)t.rssKB, ci});
+        }
+        if (++scans_ >= kScansPerBlock || rows_.size() >= kRowsPerBlock) flush();
+    }
+
+    void flush() {
+        if (fd_ < 0 || rows_.empty()) { scans_ = 0; return; }
+        HistoryBlockInfo b;
+        b.offset = end_;
+        b.rows = (uint32_t)rows_.size();
+        b.tMin = rows_.front().timeMs;
+        b.tMax = rows_.back().timeMs;
+        b.pidMin = UINT32_MAX;
+        b.pidMax = 0;
+
+        std::string payload, timeCol, pidCol, rssCol, commCol;
+        putVarint(payload, dict_.size());
+        for (auto &d : dict_) { putVarint(payload, d.size()); payload += d; }
+        std::unordered_map<uint32_t, uint64_t> lastRss;
+        int64_t prevT = b.tMin;
+        uint32_t prevPid = 0;
+        for (auto &r : rows_) {
+            b.pidMin = std::min(b.pidMin, r.pid);
+            b.pidMax = std::max(b.pidMax, r.pid);
+            putVarint(timeCol, (uint64_t)(r.timeMs - prevT));
+            putVarint(pidCol, zigzag((int64_t)r.pid - (int64_t)prevPid));
+            uint64_t& last = lastRss[r.pid];
+            putVarint(rssCol, zigzag((int64_t)r.rssKB - (int64_t)last));
+            putVarint(commCol, r.comm);
+            prevT = r.timeMs; prevPid = r.pid; last = r.rssKB;
+        }
+        putVarint(payload, timeCol.size());
+        putVarint(payload, pidCol.size());
+        putVarint(payload, rssCol.size());
+        putVarint(payload, commCol.size());
+        payload += timeCol; payload += pidCol; payload += rssCol; payload += commCol;
+        b.payloadBytes = (uint32_t)payload.size();
+
+        std::string out("HBLK", 4);
+        putU32(out, b.payloadBytes);
+        putU32(out, b.rows);
+        putU32(out, b.pidMin);
+        putU32(out, b.pidMax);
+        putU32(out, 0);
+        putU64(out, (uint64_t)b.tMin);
+        putU64(out, (uint64_t)b.tMax);
+        out += payload;
+        if (writeAll(fd_, out)) {
+            end_ += out.size();
+            blocks_.push_back(b);
+        } else {
+            std::cerr << "history write failed: " << strerror(errno) << "\n";
+        }
+        rows_.clear();
+        dict_.clear();
+        dictIndex_.clear();
+        scans_ = 0;
+    }
+
+    void close() {
+        if (fd_ < 0) return;
+        flush();
+        std::string idx("HIDX", 4);
+        putU32(idx, (uint32_t)blocks_.size());
+        for (auto &b : blocks_) {
+            putU64(idx, b.offset);
+            putU64(idx, (uint64_t)b.tMin);
+            putU64(idx, (uint64_t)b.tMax);
+            putU32(idx, b.pidMin);
+            putU32(idx, b.pidMax);
+            putU32(idx, b.rows);
+            putU32(idx, b.payloadBytes);
+        }
+        putU64(idx, end_);
+        idx.append(kHistEnd, 8);
+        writeAll(fd_, idx);
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    // One block covers about a minute at 1 s intervals; a crash loses at most
+    // the unflushed block.
+    static const unsigned kScansPerBlock = 60;
+    static const size_t kRowsPerBlock = 16384;
+
+    // Closes without writing an index: close() would append one at end_,
+    // which is not yet known, and corrupt an existing file.
+    bool fail() {
+        ::close(fd_);
+        fd_ = -1;
+        blocks_.clear();
+        return false;
+    }
+
+    int fd_ = -1;
+    uint64_t end_ = 0;
+    unsigned scans_ = 0;
+    std::vector<HistoryBlockInfo> blocks_;
+    std::vector<HistoryRow> rows_;
+    std::vector<std::string> dict_;
+    std::unordered_map<std::string, uint32_t> dictIndex_;
+};
+
+// Reads one block payload. With wantPid/wantComm set, returns false early
+// (without decoding the columns) when the block cannot contain a match.
+static bool decodeHistoryBlock(int fd, const HistoryBlockInfo& b, long long wantPid, const std::string* wantComm,
+                               std::vector<std::string>& dict, std::vector<HistoryRow>& rows) {
+    dict.clear();
+    rows.clear();
+    std::vector<unsigned char> buf(b.payloadBytes);
+    if (!preadAll(fd, buf.data(), buf.size(), (off_t)(b.offset + kHistBlockHeader))) return false;
+    const unsigned char* p = buf.data();
+    const unsigned char* end = p + buf.size();
+    uint64_t n = 0;
+    if (!getVarint(p, end, n)) return false;
+    long long wantCommIdx = -1;
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t len = 0;
+        if (!getVarint(p, end, len) || (uint64_t)(end - p) < len) return false;
+        dict.emplace_back((const char*)p, (size_t)len);
+        if (wantComm && dict.back() == *wantComm) wantCommIdx = (long long)i;
+        p += len;
+    }
+    if (wantComm && wantCommIdx < 0) return false;
+    uint64_t lens[4];
+    for (auto &l : lens) if (!getVarint(p, end, l)) return false;
+    const unsigned char* cols[4];
+    for (int i = 0; i < 4; ++i) {
+        if ((uint64_t)(end - p) < lens[i]) return false;
+        cols[i] = p;
+        p += lens[i];
+    }
+    const unsigned char* ends[4] = {cols[0] + lens[0], cols[1] + lens[1], cols[2] + lens[2], cols[3] + lens[3]};
+
+    rows.resize(b.rows);
+    int64_t t = b.tMin;
+    int64_t pid = 0;
+    bool pidSeen = wantPid < 0;
+    for (uint32_t i = 0; i < b.rows; ++i) {
+        uint64_t v;
+        if (!getVarint(cols[1], ends[1], v)) return false;
+        pid += unzigzag(v);
+        rows[i].pid = (uint32_t)pid;
+        if (pid == wantPid) pidSeen = true;
+    }
+    if (!pidSeen) return false;
+    std::unordered_map<uint32_t, uint64_t> lastRss;
+    for (uint32_t i = 0; i < b.rows; ++i) {
+        uint64_t dt, dr, ci;
+        if (!getVarint(cols[0], ends[0], dt) || !getVarint(cols[2], ends[2], dr) || !getVarint(cols[3], ends[3], ci))
+            return false;
+        if (ci >= dict.size()) return false;
+        t += (int64_t)dt;
+        uint64_t& last = lastRss[rows[i].pid];
+        last = (uint64_t)((int64_t)last + unzigzag(dr));
+        rows[i].timeMs = t;
+        rows[i].rssKB = last;
+        rows[i].comm = (uint32_t)ci;
+    }
+    return true;
+}
+
+static int64_t realtimeMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static std::string formatTimeMs(int64_t ms) {
+    time_t secs = (time_t)(ms / 1000);
+    struct tm tmv;
+    gmtime_r(&secs, &tmv);
+    char buf[40];
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tmv);
+    snprintf(buf + n, sizeof(buf) - n, ".%03dZ", (int)(ms % 1000));
+    return buf;
+}
+
+struct QueryOptions {
+    std::string file;
+    long long pid = -1;
+    std::string comm;
+    size_t topN = 0;
+    int64_t atMs = -1;        // -1 = latest sample
+    int64_t fromMs = INT64_MIN;
+    int64_t toMs = INT64_MAX;
+};
+
+int runQuery(const QueryOptions& q) {
+    int fd = ::open(q.file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << q.file << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::vector<HistoryBlockInfo> blocks;
+    uint64_t dataEnd = 0;
+    if (!loadHistoryIndex(fd, blocks, dataEnd)) {
+        std::cerr << "Not a history file: " << q.file << "\n";
+        ::close(fd);
+        return 1;
+    }
+    std::vector<std::string> dict;
+    std::vector<HistoryRow> rows;
+
+    if (q.topN > 0) {
+        // Latest block starting at or before T, then the latest scan <= T in it.
+        int64_t at = q.atMs < 0 ? INT64_MAX : q.atMs;
+        for (size_t i = blocks.size(); i-- > 0;) {
+            if (blocks[i].tMin > at) continue;
+            if (!decodeHistoryBlock(fd, blocks[i], -1, nullptr, dict, rows)) continue;
+            int64_t scanT = INT64_MIN;
+            for (auto &r : rows) if (r.timeMs <= at) scanT = std::max(scanT, r.timeMs);
+            std::vector<HistoryRow> sel;
+            for (auto &r : rows) if (r.timeMs == scanT) sel.push_back(r);
+            size_t n = std::min(q.topN, sel.size());
+            std::partial_sort(sel.begin(), sel.begin() + n, sel.end(),
+                              [](const HistoryRow& a, const HistoryRow& b) { return a.rssKB > b.rssKB; });
+            std::cout << "Top " << n << " at " << formatTimeMs(scanT) << ":\n";
+            for (size_t k = 0; k < n; ++k) {
+                std::cout << "PID=" << sel[k].pid << " name=" << dict[sel[k].comm]
+                          << " rssMB=" << (sel[k].rssKB / 1024) << "\n";
+            }
+            ::close(fd);
+            return 0;
+        }
+        std::cout << "No samples at or before the requested time\n";
+        ::close(fd);
+        return 0;
+    }
+
+    size_t decoded = 0, matched = 0;
+    for (auto &b : blocks) {
+        if (b.tMax < q.fromMs || b.tMin > q.toMs) continue;
+        if (q.pid >= 0 && (q.pid < (long long)b.pidMin || q.pid > (long long)b.pidMax)) continue;
+        if (!decodeHistoryBlock(fd, b, q.pid, q.comm.empty() ? nullptr : &q.comm, dict, rows)) continue;
+        ++decoded;
+        for (auto &r : rows) {
+            if (r.timeMs < q.fromMs || r.timeMs > q.toMs) continue;
+            if (q.pid >= 0 && (long long)r.pid != q.pid) continue;
+            if (!q.comm.empty() && dict[r.comm] != q.comm) continue;
+            std::cout << formatTimeMs(r.timeMs) << " PID=" << r.pid << " name=" << dict[r.comm]
+                      << " rssMB=" << (r.rssKB / 1024) << "\n";
+            ++matched;
+        }
+    }
+    std::cerr << matched << " samples from " << decoded << " of " << blocks.size() << " blocks\n";
+    ::close(fd);
+    return 0;
+}
+
+static volatile sig_atomic_t g_watchStop = 0;   // set by SIGINT/SIGTERM in watch and serve
+static void onWatchSignal(int) { g_watchStop = 1; }
+
+// Sleeps up to ms, returning early if a stop signal arrives.
+static void watchSleep(unsigned ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (!g_watchStop && nanosleep(&ts, &ts) != 0) {}
+}
+
+static std::string formatPsi(double v) {
+    if (v < 0) return "n/a";
+    std::ostringstream os;
+    os << v;
+    return os.str();
+}
+
+static void printScanStats(std::ostream& os) {
+    const ScanCounters& sc = g_scanStats;
+    uint64_t scans = sc.scans ? sc.scans : 1;
+    os << "Scans: " << sc.scans << "  pids in last scan: " << sc.lastPids << "\n";
+    os << "phase        count      p50us      p90us      p99us      maxus     meanus\n";
+    for (int i = 0; i < PhaseCount; ++i) {
+        const LatencyHistogram& h = sc.phases[i];
+        char line[128];
+        snprintf(line, sizeof(line), "%-10s %7llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", kScanPhaseNames[i],
+                 (unsigned long long)h.count(), h.quantile(0.50) / 1e3, h.quantile(0.90) / 1e3,
+                 h.quantile(0.99) / 1e3, h.max() / 1e3, h.count() ? h.sum() / 1e3 / h.count() : 0.0);
+        os << line;
+    }
+    os << "syscalls per scan:";
+    for (int i = 0; i < SysCount; ++i) os << " " << kScanSyscallNames[i] << "=" << sc.syscalls[i] / scans;
+    os << "\n/proc bytes per scan: " << sc.procBytesRead / scans
+       << "\nallocations per scan: " << sc.allocations / scans
+       << " (" << sc.allocBytes / scans << " bytes)\n";
+}
+
+static void appendScanStatsOpenMetrics(std::string& body) {
+    const ScanCounters& sc = g_scanStats;
+    std::ostringstream os;
+    os << "# TYPE ex1_scan_phase_seconds summary\n"
+       << "# UNIT ex1_scan_phase_seconds seconds\n";
+    static const double qs[] = {0.5, 0.9, 0.99};
+    for (int i = 0; i < PhaseCount; ++i) {
+        const LatencyHistogram& h = sc.phases[i];
+        for (double q : qs) {
+            os << "ex1_scan_phase_seconds{phase=\"" << kScanPhaseNames[i] << "\",quantile=\"" << q << "\"} "
+               << h.quantile(q) / 1e9 << "\n";
+        }
+        os << "ex1_scan_phase_seconds_count{phase=\"" << kScanPhaseNames[i] << "\"} " << h.count() << "\n"
+           << "ex1_scan_phase_seconds_sum{phase=\"" << kScanPhaseNames[i] << "\"} " << h.sum() / 1e9 << "\n";
+    }
+    os << "# TYPE ex1_scan_syscalls counter\n";
+    for (int i = 0; i < SysCount; ++i)
+        os << "ex1_scan_syscalls_total{call=\"" << kScanSyscallNames[i] << "\"} " << sc.syscalls[i] << "\n";
+    os << "# TYPE ex1_scan_proc_read_bytes counter\n"
+       << "# UNIT ex1_scan_proc_read_bytes bytes\n"
+       << "ex1_scan_proc_read_bytes_total " << sc.procBytesRead << "\n"
+       << "# TYPE ex1_scan_allocations counter\n"
+       << "ex1_scan_allocations_total " << sc.allocations << "\n"
+       << "# TYPE ex1_scan_allocated_bytes counter\n"
+       << "# UNIT ex1_scan_allocated_bytes bytes\n"
+       << "ex1_scan_allocated_bytes_total " << sc.allocBytes << "\n";
+    body += os.str();
+}
+
+// Result of one scheduled scan.
+struct ScanTick {
+    unsigned long seq = 0;
+    ProcessList procs;
+    PressureSample pressure;
+    double forksPerSec = 0;
+    double urgency = 0;
+    double cpuMs = 0, wallMs = 0;
+    unsigned sleepMs = 0;       // scheduler's choice before the next scan
+    bool budgetLimited = false;
+};
+
+// Runs a scan, samples pressure afterwards and asks the scheduler for the next
+// interval. Shared by watch and serve.
+class ScanLoop {
+public:
+    explicit ScanLoop(const WatchOptions& o) : opts_(o), sched_(o) {
+        readPressureSample(prev_);
+        prevAt_ = monotonicMs();
+    }
+
+    void scan(ScanTick& t) {
+        double wall0 = monotonicMs();
+        double cpu0 = threadCpuMs();
+        t.procs = listHighMemoryProcesses(opts_.thresholdMB);
+        t.cpuMs = threadCpuMs() - cpu0;
+        t.wallMs = monotonicMs() - wall0;
+
+        t.pressure = PressureSample();
+        readPressureSample(t.pressure);
+        double now = monotonicMs();
+        double dt = (now - prevAt_) / 1000.0;
+        // The first window is only as long as one scan, too short for a rate.
+        t.forksPerSec = (seq_ > 0 && dt > 0 && t.pressure.forksTotal >= prev_.forksTotal)
+            ? (t.pressure.forksTotal - prev_.forksTotal) / dt : 0.0;
+        prev_ = t.pressure;
+        prevAt_ = now;
+
+        t.seq = ++seq_;
+        t.urgency = sched_.urgency(t.pressure, t.forksPerSec);
+        t.sleepMs = sched_.next(t.urgency, t.cpuMs, t.wallMs);
+        t.budgetLimited = sched_.budgetLimited();
+    }
+
+private:
+    WatchOptions opts_;
+    AdaptiveScheduler sched_;
+    PressureSample prev_;
+    double prevAt_ = 0;
+    unsigned long seq_ = 0;
+};
+
+static void installStopHandlers() {
+    struct sigaction sa = {};
+    sa.sa_handler = onWatchSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+
+// One proactive reclaim round: the coldest leaf cgroups give back up to
+// cgroupReclaimMB each, never more than half of their cold memory.
+static void reclaimColdCgroups(const WatchOptions& opts, std::ostream& os) {
+    std::vector<ColdCgroup> cgs;
+    findColdCgroups(cgroupRoot(), 0, cgs);
+    size_t done = 0;
+    for (auto &cg : cgs) {
+        if (done >= opts.cgroupTop || cg.coldBytes == 0) break;
+        if (cgroupPsiSomeAvg10(cg.dir) > opts.cgroupPsiMax) continue;   // already stalling
+        unsigned long long bytes = std::min((unsigned long long)opts.cgroupReclaimMB * 1024 * 1024, cg.coldBytes / 2);
+        if (bytes < 1024 * 1024) continue;
+        CgroupReclaimResult r;
+        cgroupReclaim(cg.dir, bytes, 32ULL * 1024 * 1024, 0, r);
+        os << "reclaim ";
+        printCgroupReclaim(os, cg.dir.substr(cgroupRoot().size()), r);
+        ++done;
+    }
+}
+
+int runWatch(const WatchOptions& opts) {
+    installStopHandlers();
+
+    ScanLoop loop(opts);
+    SnapshotDiff diff(opts.epsilonMB * 1024ULL * 1024ULL);
+    HistoryWriter recorder;
+    if (!opts.recordPath.empty() && !recorder.open(opts.recordPath)) {
+        std::cerr << "Cannot record to " << opts.recordPath << "\n";
+        return 1;
+    }
+    std::string deltaOut;
+    ScanTick t;
+    double lastCgroupRound = -1e18;
+    ProcessDetailsCache details(opts.detailMaxLen);
+    OwnerResolver owner;
+    RowExtras extras;
+    if (opts.showDetails) extras.details = &details;
+    if (opts.showOwner) extras.owner = &owner;
+    bool byGrowth = std::find(opts.sortKeys.begin(), opts.sortKeys.end(), SortGrowth) != opts.sortKeys.end();
+    std::unordered_map<int32_t, uint32_t> previousRssKB;
+    ProcessTable sortTable;
+
+    while (!g_watchStop && (opts.maxScans == 0 || t.seq < opts.maxScans)) {
+        loop.scan(t);
+        sortProcessList(sortTable, t.procs, opts.sortKeys, previousRssKB);
+        if (byGrowth) {
+            previousRssKB.clear();
+            for (auto &r : t.procs) previousRssKB[r.pid] = r.rssKB;
+        }
+        if (!opts.recordPath.empty()) recorder.append(realtimeMs(), t.procs);
+
+        uint64_t out0 = monotonicNs();
+        deltaOut.clear();
+        size_t records = opts.deltaOnly ? diff.update(t.procs, deltaOut) : t.procs.size();
+        // In delta mode a quiet scan produces no output at all.
+        if (!opts.deltaOnly || records > 0) {
+            std::cout << "--- scan " << t.seq
+                      << " availMB=" << (t.pressure.memAvailableKB / 1024)
+                      << " psiSome10=" << formatPsi(t.pressure.psiSomeAvg10)
+                      << " forks/s=" << (unsigned long)t.forksPerSec
+                      << " urgency=" << (int)(t.urgency * 100) << "%"
+                      << " scanCpuMs=" << t.cpuMs
+                      << " nextMs=" << t.sleepMs << (t.budgetLimited ? " (cpu budget)" : "")
+                      << "\n";
+        }
+        if (opts.deltaOnly) {
+            std::cout << deltaOut;
+        } else {
+            for (auto &r : t.procs) {
+                std::cout << "PID=" << r.pid << " name=" << r.comm << " rssMB=" << (r.rssKB / 1024);
+                printRowExtras(std::cout, extras, r.pid);
+                std::cout << "\n";
+            }
+            if (opts.showDetails) details.sweep();
+            if (opts.showOwner) owner.refresh();
+        }
+        std::cout.flush();
+        recordScanPhase(PhaseOutput, monotonicNs() - out0);
+
+        if (opts.cgroupReclaimMB > 0 && monotonicMs() - lastCgroupRound >= opts.cgroupEverySec * 1000.0) {
+            lastCgroupRound = monotonicMs();
+            reclaimColdCgroups(opts, std::cout);
+            std::cout.flush();
+        }
+
+        if (opts.maxScans != 0 && t.seq >= opts.maxScans) break;
+        watchSleep(t.sleepMs);
+    }
+    return 0;
+}
 
-#ifdef _WIN32
-static SIZE_T getProcessWorkingSet(HANDLE hProcess) {
-    PROCESS_MEMORY_COUNTERS pmc = {};
-    if (GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc))) {
-        return pmc.WorkingSetSize;
+// stats: runs a number of scans back to back and reports the instrumentation.
+int runStats(const WatchOptions& opts) {
+    std::string sink;
+    for (unsigned long n = 0; n < opts.maxScans; ++n) {
+        auto procs = listHighMemoryProcesses(opts.thresholdMB);
+        // Output phase: format rows the way list does, without writing them.
+        uint64_t out0 = monotonicNs();
+        sink.clear();
+        for (auto &r : procs) {
+            sink += "PID=" + std::to_string(r.pid) + " name=";
+            sink += r.comm;
+            sink += " rssMB=" + std::to_string(r.rssKB / 1024) + "\n";
+        }
+        recordScanPhase(PhaseOutput, monotonicNs() - out0);
+        if (opts.baseIntervalMs > 0 && n + 1 < opts.maxScans) watchSleep(opts.baseIntervalMs);
     }
+    printScanStats(std::cout);
     return 0;
 }
 
-// Helper: convert TCHAR (ANSI or WCHAR) to UTF-8 std::string
-static std::string tchar_to_utf8(const TCHAR* s) {
-#ifdef UNICODE
-    if (!s) return std::string();
-    int needed = WideCharToMultiByte(CP_UTF8, 0, s, -1, nullptr, 0, nullptr, nullptr);
-    if (needed <= 0) return std::string();
-    std::string out(needed, '\0');
-    WideCharToMultiByte(CP_UTF8, 0, s, -1, &out[0], needed, nullptr, nullptr);
-    // remove trailing null
-    if (!out.empty() && out.back() == '\0') out.pop_back();
-    return out;
-#else
-    return std::string(s ? s : "");
-#endif
+// ---------------------------------------------------------------------------
+// Dry run (list --kill --dry-run): predicted freed memory.
+//
+// Per victim the prediction is its unique memory (USS), which is what its
+// death releases no matter what else survives; PSS is shown for reference.
+// With --pagemap the batch is also accounted page by page: every present page
+// of the victims is looked up in /proc/kpagecount, and a page counts as freed
+// when all of its mappings belong to victims, which also catches memory that
+// is shared only inside the batch (e.g. between a parent and its children).
+// Reading PFNs requires CAP_SYS_ADMIN.
+// ---------------------------------------------------------------------------
+
+// Adds the present pages of pid to mapped (pfn -> mappings among the victims).
+// Returns false when the kernel hides PFNs from us.
+static bool collectPagemap(pid_t pid, std::unordered_map<uint64_t, uint32_t>& mapped) {
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/pagemap", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    std::ifstream maps(path);
+    std::string line;
+    std::vector<uint64_t> entries(4096);
+    bool sawPfn = false, sawPresent = false;
+    while (std::getline(maps, line)) {
+        unsigned long long start = 0, end = 0;
+        if (sscanf(line.c_str(), "%llx-%llx", &start, &end) != 2) continue;
+        for (uint64_t page = start / pageSize; page < end / pageSize;) {
+            size_t n = (size_t)std::min<uint64_t>(entries.size(), end / pageSize - page);
+            if (!preadAll(fd, entries.data(), n * 8, (off_t)(page * 8))) break;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t e = entries[i];
+                if (!(e >> 63)) continue;                // not present (or swapped)
+                sawPresent = true;
+                uint64_t pfn = e & ((1ULL << 55) - 1);
+                if (pfn == 0) continue;
+                sawPfn = true;
+                ++mapped[pfn];
+            }
+            page += n;
+        }
+    }
+    close(fd);
+    return sawPfn || !sawPresent;
 }
 
-void trimCurrentProcessWorkingSet() {
-    HANDLE h = GetCurrentProcess();
-    SIZE_T before = getProcessWorkingSet(h);
-    std::cout << "Before trim: " << (before / 1024) << " KB\n";
+static void printFreedPrediction(const ProcessList& rows, bool pagemap) {
+    std::cout << "Dry run: no signal will be sent\n";
+    size_t totalUss = 0, totalPss = 0, totalRss = 0;
+    for (auto &r : rows) {
+        size_t pss = 0, uss = 0;
+        bool ok = readSmapsRollup(r.pid, pss, uss);
+        std::cout << "  PID=" << r.pid << " name=" << r.comm << " rssMB=" << r.rssKB / 1024;
+        if (ok) std::cout << " pssMB=" << pss / 1024 / 1024 << " predictedMB=" << uss / 1024 / 1024 << "\n";
+        else std::cout << " (smaps_rollup unreadable, predicting RSS)\n";
+        totalUss += ok ? uss : r.rss();
+        totalPss += ok ? pss : r.rss();
+        totalRss += r.rss();
+    }
+    std::cout << "Predicted freed: " << totalUss / 1024 / 1024 << " MB unique (PSS " << totalPss / 1024 / 1024
+              << " MB, RSS " << totalRss / 1024 / 1024 << " MB) from " << rows.size() << " processes; MemAvailable now "
+              << readMemAvailableKB() / 1024 << " MB\n";
+    if (!pagemap) return;
 
-    // Ask the OS to trim the working set for this process.
-    // Passing -1 for min and max is a documented technique to tell Windows to trim.
-    if (!SetProcessWorkingSetSize(h, (SIZE_T)-1, (SIZE_T)-1)) {
-        std::cerr << "SetProcessWorkingSetSize failed, error=" << GetLastError() << "\n";
+    std::unordered_map<uint64_t, uint32_t> mapped;
+    for (auto &r : rows) {
+        if (!collectPagemap(r.pid, mapped)) {
+            std::cout << "pagemap: PFNs not visible (needs CAP_SYS_ADMIN), no page-level prediction\n";
+            return;
+        }
+    }
+    int kfd = open("/proc/kpagecount", O_RDONLY | O_CLOEXEC);
+    if (kfd < 0) {
+        std::cout << "pagemap: cannot open /proc/kpagecount: " << strerror(errno) << "\n";
+        return;
+    }
+    size_t freed = 0, shared = 0;
+    for (auto &e : mapped) {
+        uint64_t count = 0;
+        if (!preadAll(kfd, &count, 8, (off_t)(e.first * 8))) continue;
+        if (count <= e.second) ++freed;
+        else ++shared;
     }
+    close(kfd);
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    std::cout << "pagemap: " << freed * pageSize / 1024 / 1024 << " MB mapped only by these processes would be freed, "
+              << shared * pageSize / 1024 / 1024 << " MB stays mapped by others\n";
+}
 
-    SIZE_T after = getProcessWorkingSet(h);
-    std::cout << "After  trim: " << (after / 1024) << " KB\n";
+// ---------------------------------------------------------------------------
+// reclaim: free a target amount of memory with as few victims as possible.
+//
+// Freeable memory per candidate is its unique memory (private clean + dirty
+// from smaps_rollup), falling back to PSS and then RSS when smaps_rollup is
+// unreadable. Taking the k largest candidates maximises what k victims free,
+// so the smallest k whose prefix reaches the target is the minimum number of
+// victims. Each pick, from the last to the first, is then swapped for the
+// smallest candidate that still meets the target, to limit collateral damage.
+// ---------------------------------------------------------------------------
+
+struct ReclaimOptions {
+    size_t targetMB = 0;
+    size_t minSizeMB = 32;      // candidates below this RSS are not considered
+    unsigned graceMs = 5000;
+    bool dryRun = false;        // print the plan only
+    VictimPolicy policy;
+};
+
+static size_t freeableBytes(const KillCandidate& c) {
+    return c.uss ? c.uss : (c.pss ? c.pss : c.rss);
 }
 
-std::vector<std::tuple<DWORD, std::string, SIZE_T>> listHighMemoryProcesses(size_t thresholdMB) {
-    std::vector<std::tuple<DWORD, std::string, SIZE_T>> out;
-    HANDLE snap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-    if (snap == INVALID_HANDLE_VALUE) return out;
+// Returns indices into cands of the chosen victims; shortBytes receives how
+// much the whole set falls short of the target (0 if it is met).
+static std::vector<size_t> chooseReclaimVictims(const std::vector<KillCandidate>& cands, size_t target,
+                                                size_t& shortBytes) {
+    std::vector<size_t> order(cands.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    // Largest first; among equals, the policy's preferred victim first.
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        size_t fa = freeableBytes(cands[a]), fb = freeableBytes(cands[b]);
+        return fa != fb ? fa > fb : cands[a].score > cands[b].score;
+    });
 
-    PROCESSENTRY32 pe;
-    pe.dwSize = sizeof(pe);
-    if (Process32First(snap, &pe)) {
-        do {
-            DWORD pid = pe.th32ProcessID;
-            std::string name = tchar_to_utf8(pe.szExeFile);
-            HANDLE h = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid);
-            SIZE_T rss = 0;
-            if (h) {
-                rss = getProcessWorkingSet(h);
-                CloseHandle(h);
+    size_t k = 0, sum = 0;
+    while (k < order.size() && sum < target) sum += freeableBytes(cands[order[k++]]);
+    shortBytes = sum < target ? target - sum : 0;
+    std::vector<size_t> chosen(order.begin(), order.begin() + k);
+    if (shortBytes > 0) return chosen;
+
+    std::vector<bool> used(cands.size(), false);
+    for (size_t i : chosen) used[i] = true;
+    for (size_t j = k; j-- > 0;) {
+        size_t rest = sum - freeableBytes(cands[chosen[j]]);
+        size_t need = target > rest ? target - rest : 0;
+        // order is descending, so the last fitting unused candidate is the smallest.
+        size_t best = chosen[j];
+        for (size_t i : order) {
+            if (freeableBytes(cands[i]) < need) break;
+            if (!used[i] && freeableBytes(cands[i]) < freeableBytes(cands[best])) best = i;
+        }
+        if (best != chosen[j]) {
+            used[chosen[j]] = false;
+            used[best] = true;
+            sum = rest + freeableBytes(cands[best]);
+            chosen[j] = best;
+        }
+    }
+    return chosen;
+}
+
+int runReclaim(ReclaimOptions opts) {
+    opts.policy.readUss = true;
+    PidfdTable handles;
+    KillPlan plan(opts.policy);
+    listHighMemoryProcesses(opts.minSizeMB, &handles, &plan);
+    plan.finish();
+
+    const size_t target = opts.targetMB * 1024ULL * 1024ULL;
+    const std::vector<KillCandidate>& cands = plan.victims();
+    size_t shortBytes = 0;
+    std::vector<size_t> chosen = chooseReclaimVictims(cands, target, shortBytes);
+
+    size_t expected = 0;
+    for (size_t i : chosen) expected += freeableBytes(cands[i]);
+    std::cout << "Reclaim target " << opts.targetMB << " MB, MemAvailable " << readMemAvailableKB() / 1024
+              << " MB, " << cands.size() << " candidates >= " << opts.minSizeMB << " MB ("
+              << plan.skipped().size() << " protected by policy)\n";
+    std::cout << "Plan: " << chosen.size() << " victims, expected to free " << expected / 1024 / 1024 << " MB\n";
+    ProcessList rows;
+    for (size_t i : chosen) {
+        const KillCandidate& c = cands[i];
+        std::cout << "PID=" << c.pid << " name=" << c.name << " freeableMB=" << freeableBytes(c) / 1024 / 1024
+                  << " rssMB=" << c.rss / 1024 / 1024 << "\n";
+        rows.push_back(makeProcessRecord(c.pid, c.name, c.rss));
+    }
+    if (shortBytes > 0) {
+        std::cout << "Killable candidates fall short of the target by " << shortBytes / 1024 / 1024 << " MB\n";
+    }
+    if (rows.empty()) return 1;
+    if (opts.dryRun) {
+        printFreedPrediction(rows, false);
+        return shortBytes > 0 ? 1 : 0;
+    }
+
+    TerminationSummary sum = terminateListed(rows, handles, opts.graceMs);
+    long long gained = ((long long)sum.availAfterKB - (long long)sum.availBeforeKB) * 1024;
+    bool met = gained >= (long long)target;
+    std::cout << "Target " << opts.targetMB << " MB: MemAvailable +" << (gained > 0 ? gained / 1024 / 1024 : 0)
+              << " MB (" << (met ? "met" : "short by " + std::to_string((target - gained) / 1024 / 1024) + " MB")
+              << ")\n";
+    return met ? 0 : 1;
+}
+
+// pageout: explicit pids, or the N largest processes above a threshold.
+struct PageoutOptions {
+    std::vector<pid_t> pids;
+    size_t topN = 0;
+    size_t thresholdMB = 0;
+    int advice = MADV_PAGEOUT;
+};
+
+int runPageout(const PageoutOptions& opts) {
+    PidfdTable handles;
+    ProcessList targets;
+    if (opts.topN > 0) {
+        // Pidfds only for the N that will be paged out, not for every process
+        // above the (default 0) threshold. The scan predates pidfd_open, so a
+        // target whose comm changed meanwhile (pid reused) is left alone.
+        targets = listHighMemoryProcesses(opts.thresholdMB);
+        sortProcessList(targets, {SortRss}, {});
+        if (targets.size() > opts.topN) targets.resize(opts.topN);
+        char path[64], buf[64];
+        for (auto &t : targets) {
+            if (handles.capture(t.pid) < 0) continue;
+            snprintf(path, sizeof(path), "/proc/%d/comm", (int)t.pid);
+            ssize_t n = readProcFile(path, buf, sizeof(buf));
+            size_t len = n > 0 ? (size_t)n : 0;
+            if (len > 0 && buf[len - 1] == '\n') --len;
+            if (t.name() != std::string(buf, len)) handles.release(t.pid);
+        }
+    } else {
+        char path[64], buf[64];
+        for (pid_t pid : opts.pids) {
+            snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+            ssize_t n = readProcFile(path, buf, sizeof(buf));
+            size_t len = n > 0 ? (size_t)n : 0;
+            if (len > 0 && buf[len - 1] == '\n') --len;
+            handles.capture(pid);
+            targets.push_back(makeProcessRecord(pid, buf, len, 0));
+        }
+    }
+
+    char swapBuf[2048];
+    const char* st = readProcFile("/proc/meminfo", swapBuf, sizeof(swapBuf)) > 0 ? strstr(swapBuf, "SwapTotal:") : nullptr;
+    if (opts.advice == MADV_PAGEOUT && st && strtoull(st + 10, nullptr, 10) == 0) {
+        std::cout << "No swap or zram configured: anonymous pages cannot be paged out\n";
+    }
+
+    int failures = 0;
+    for (auto &t : targets) {
+        pid_t pid = t.pid;
+        std::cout << "PID=" << pid << " name=" << t.comm << " ";
+        int pfd = handles.get(pid);
+        if (pfd < 0) {
+            std::cout << "FAILED: cannot open pidfd\n";
+            ++failures;
+            continue;
+        }
+        PageoutResult r;
+        bool ok = tryPageOutProcess(pid, pfd, opts.advice, r);
+        std::cout << "rssMB " << r.rssBeforeKB / 1024 << " -> " << r.rssAfterKB / 1024
+                  << " (anon " << r.anonBeforeKB / 1024 << " -> " << r.anonAfterKB / 1024
+                  << ", swap " << r.swapBeforeKB / 1024 << " -> " << r.swapAfterKB / 1024 << ") "
+                  << r.vmas << " vmas, " << r.calls << " calls, advised " << r.advisedBytes / 1024 / 1024 << " MB";
+        if (!ok) {
+            std::cout << " FAILED: " << strerror(r.error);
+            ++failures;
+        }
+        std::cout << "\n";
+    }
+    return failures ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Freezing (list --freeze / thaw).
+//
+// A process that is alone in its cgroup v2 is frozen through cgroup.freeze,
+// which the process cannot observe or undo; otherwise it gets SIGSTOP. Either
+// way it stops allocating at once. With a timeout, ex1 stays around and sends
+// SIGKILL to whatever has not been thawed (by `thaw`) when it expires.
+// ---------------------------------------------------------------------------
+
+struct FrozenProcess {
+    pid_t pid = 0;
+    int pidfd = -1;
+    std::string name;
+    std::string cgroupDir;      // frozen through this cgroup; empty = SIGSTOP
+    bool frozen = false;
+    int error = 0;
+};
+
+// The cgroup v2 directory of pid if pid is its only process, else "".
+static std::string ownCgroupDir(pid_t pid) {
+    std::ifstream in("/proc/" + std::to_string(pid) + "/cgroup");
+    std::string line, path;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 3, "0::") == 0) { path = line.substr(3); break; }
+    }
+    if (path.empty() || path == "/") return std::string();
+    std::string dir = cgroupRoot() + path;
+    std::ifstream procs(dir + "/cgroup.procs");
+    long long first = 0, more = 0;
+    if (!(procs >> first) || first != pid || (procs >> more)) return std::string();
+    struct stat st;
+    if (stat((dir + "/cgroup.freeze").c_str(), &st) != 0) return std::string();
+    return dir;
+}
+
+static bool writeCgroupFile(const std::string& file, const char* value) {
+    int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+    int err = errno;
+    close(fd);
+    errno = err;
+    return ok;
+}
+
+// "frozen 1" in cgroup.events once every task has stopped.
+static bool cgroupFrozen(const std::string& dir) {
+    std::ifstream in(dir + "/cgroup.events");
+    std::string key;
+    int v = 0;
+    while (in >> key >> v) {
+        if (key == "frozen") return v == 1;
+    }
+    return false;
+}
+
+static bool freezeProcess(FrozenProcess& f) {
+    f.cgroupDir = ownCgroupDir(f.pid);
+    if (!f.cgroupDir.empty()) {
+        if (writeCgroupFile(f.cgroupDir + "/cgroup.freeze", "1")) {
+            for (int i = 0; i < 100 && !cgroupFrozen(f.cgroupDir); ++i) {
+                struct timespec ts = {0, 10000000L};
+                nanosleep(&ts, nullptr);
             }
-            if (rss >= thresholdMB * 1024ULL * 1024ULL) {
-                out.emplace_back(pid, name, rss);
+            f.frozen = true;
+            return true;
+        }
+        f.cgroupDir.clear();   // not writable for us: fall back to SIGSTOP
+    }
+    int r = f.pidfd >= 0 ? sysPidfdSendSignal(f.pidfd, SIGSTOP) : kill(f.pid, SIGSTOP);
+    if (r != 0) {
+        f.error = errno;
+        return false;
+    }
+    f.frozen = true;
+    return true;
+}
+
+// Process state letter from /proc/<pid>/stat, or 0 if it is gone.
+static char processState(pid_t pid) {
+    char path[64], buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (readProcFile(path, buf, sizeof(buf)) <= 0) return 0;
+    const char* p = strrchr(buf, ')');
+    return p && p[1] == ' ' ? p[2] : 0;
+}
+
+// True once the process was thawed by someone else, or has exited.
+static bool thawedOrGone(const FrozenProcess& f) {
+    if (f.pidfd >= 0 ? sysPidfdSendSignal(f.pidfd, 0) != 0 : kill(f.pid, 0) != 0) return true;
+    if (!f.cgroupDir.empty()) {
+        unsigned long long v = 1;
+        return readCgroupValue(f.cgroupDir + "/cgroup.freeze", v) && v == 0;
+    }
+    char st = processState(f.pid);
+    return st != 'T' && st != 't';
+}
+
+static int freezeListed(const ProcessList& procs, const PidfdTable& handles, unsigned timeoutSec) {
+    std::vector<FrozenProcess> frozen(procs.size());
+    int failures = 0;
+    for (size_t i = 0; i < procs.size(); ++i) {
+        FrozenProcess& f = frozen[i];
+        f.pid = procs[i].pid;
+        f.name = procs[i].name();
+        f.pidfd = handles.get(f.pid);
+        std::cout << "  PID=" << f.pid << " name=" << f.name << " ";
+        if (freezeProcess(f)) {
+            if (f.cgroupDir.empty()) std::cout << "stopped (SIGSTOP)\n";
+            else std::cout << "frozen (cgroup " << f.cgroupDir.substr(cgroupRoot().size()) << ")\n";
+        } else {
+            std::cout << "FAILED: " << strerror(f.error) << "\n";
+            ++failures;
+        }
+    }
+    if (timeoutSec == 0) {
+        std::cout << "Use 'thaw <pid>...' to resume them.\n";
+        return failures ? 1 : 0;
+    }
+
+    std::cout << "Waiting " << timeoutSec << " s for 'thaw'; processes still frozen then get SIGKILL"
+                 " (Ctrl-C leaves them frozen)\n";
+    std::cout.flush();
+    installStopHandlers();
+    double deadline = monotonicMs() + timeoutSec * 1000.0;
+    size_t pending = 0;
+    for (auto &f : frozen) pending += f.frozen;
+    while (pending > 0 && !g_watchStop && monotonicMs() < deadline) {
+        watchSleep(200);
+        for (auto &f : frozen) {
+            if (f.frozen && thawedOrGone(f)) {
+                f.frozen = false;
+                --pending;
+                std::cout << "  PID=" << f.pid << " thawed or exited\n";
             }
-        } while (Process32Next(snap, &pe));
+        }
     }
-    CloseHandle(snap);
-    return out;
+    if (g_watchStop) return failures ? 1 : 0;
+    for (auto &f : frozen) {
+        if (!f.frozen) continue;
+        int r = f.pidfd >= 0 ? sysPidfdSendSignal(f.pidfd, SIGKILL) : kill(f.pid, SIGKILL);
+        std::cout << "  PID=" << f.pid << " name=" << f.name << " freeze timed out: "
+                  << (r == 0 ? "SIGKILL sent" : std::string("SIGKILL FAILED: ") + strerror(errno)) << "\n";
+        if (r != 0) ++failures;
+    }
+    return failures ? 1 : 0;
 }
 
-bool tryTerminateProcess(DWORD pid) {
-    HANDLE h = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
-    if (!h) return false;
-    BOOL ok = TerminateProcess(h, 1);
-    CloseHandle(h);
-    return ok == TRUE;
+// thaw: undoes --freeze (cgroup.freeze = 0 for a frozen own cgroup, else SIGCONT).
+int runThaw(const std::vector<pid_t>& pids) {
+    int failures = 0;
+    for (pid_t pid : pids) {
+        std::string dir = ownCgroupDir(pid);
+        unsigned long long v = 0;
+        bool viaCgroup = !dir.empty() && readCgroupValue(dir + "/cgroup.freeze", v) && v == 1;
+        bool ok = viaCgroup ? writeCgroupFile(dir + "/cgroup.freeze", "0") : kill(pid, SIGCONT) == 0;
+        std::cout << "PID=" << pid << " ";
+        if (ok) std::cout << (viaCgroup ? "thawed (cgroup)\n" : "continued (SIGCONT)\n");
+        else { std::cout << "FAILED: " << strerror(errno) << "\n"; ++failures; }
+    }
+    return failures ? 1 : 0;
 }
 
-#else // POSIX (Linux/macOS) - best-effort implementations
+// ---------------------------------------------------------------------------
+// Subtree and process-group termination (list --kill-tree / --kill-pgid).
+//
+// The tree is taken from a ppid/pgid index built from /proc/<pid>/stat. Every
+// member gets a pidfd and SIGSTOP, then the index is rebuilt and any child
+// forked before its parent stopped is added and stopped too, until a pass
+// finds nobody new. Only then is the whole set killed, so no member can fork,
+// escape or be re-parented in between, and the kill is one SIGKILL batch.
+// ---------------------------------------------------------------------------
 
-void trimCurrentProcessWorkingSet() {
-#ifdef __linux__
-    // On glibc systems, malloc_trim can return free pages to kernel
-    // but it's not guaranteed. We'll attempt it if available.
-    std::cout << "Requesting malloc_trim (glibc) if available...\n";
-    #if defined(__GLIBC__)
-    extern int malloc_trim(size_t);
-    int r = malloc_trim(0);
-    std::cout << "malloc_trim returned " << r << "\n";
-    #else
-    std::cout << "malloc_trim not available on this platform.\n";
-    #endif
-#else
-    std::cout << "No portable trim available on this POSIX platform.\n";
-#endif
+enum TreeMode { TreeSubtree, TreeProcessGroup };
+
+struct ProcLink {
+    pid_t ppid = 0;
+    pid_t pgid = 0;
+    unsigned long long starttime = 0;
+    std::string comm;
+    size_t rss = 0;
+};
+
+struct ProcessIndex {
+    std::unordered_map<pid_t, ProcLink> procs;
+    std::unordered_map<pid_t, std::vector<pid_t>> children;
+};
+
+static bool readProcLink(pid_t pid, ProcLink& l) {
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (readProcFile(path, buf, sizeof(buf)) <= 0) return false;
+    // "pid (comm) state ppid pgrp ..." with starttime and rss the 20th and
+    // 22nd fields after the comm.
+    const char* open = strchr(buf, '(');
+    const char* close = strrchr(buf, ')');
+    if (!open || !close || close < open) return false;
+    l.comm.assign(open + 1, close);
+    char state;
+    int ppid = 0, pgid = 0;
+    if (sscanf(close + 2, "%c %d %d", &state, &ppid, &pgid) != 3) return false;
+    l.ppid = ppid;
+    l.pgid = pgid;
+    const char* p = close;
+    for (int field = 0; p && field < 20; ++field) p = strchr(p + 1, ' ');
+    if (p) l.starttime = strtoull(p + 1, nullptr, 10);
+    for (int field = 20; p && field < 22; ++field) p = strchr(p + 1, ' ');
+    if (p) l.rss = (size_t)strtoull(p + 1, nullptr, 10) * pageSize;
+    return true;
 }
 
-std::vector<std::tuple<pid_t, std::string, size_t>> listHighMemoryProcesses(size_t thresholdMB) {
-    std::vector<std::tuple<pid_t, std::string, size_t>> out;
-#ifdef __linux__
-    DIR* d = opendir("/proc");
-    if (!d) return out;
-    struct dirent* e;
-    while ((e = readdir(d)) != nullptr) {
-        pid_t pid = atoi(e->d_name);
-        if (pid <= 0) continue;
-        std::string statm = std::string("/proc/") + e->d_name + "/statm";
-        std::ifstream f(statm);
-        if (!f) continue;
-        size_t sizePages = 0, resident = 0;
-        f >> sizePages >> resident;
-        long pageSize = sysconf(_SC_PAGESIZE);
-        size_t rss = resident * pageSize;
-        if (rss >= thresholdMB * 1024ULL * 1024ULL) {
-            // try to read name
-            std::string commPath = std::string("/proc/") + e->d_name + "/comm";
-            std::ifstream c(commPath);
-            std::string name;
-            if (c) std::getline(c, name);
-            out.emplace_back(pid, name, rss);
+static void buildProcessIndex(ProcessIndex& idx) {
+    idx.procs.clear();
+    idx.children.clear();
+    std::vector<pid_t> pids;
+    enumeratePids(pids);
+    for (pid_t pid : pids) {
+        ProcLink l;
+        if (!readProcLink(pid, l)) continue;
+        idx.children[l.ppid].push_back(pid);
+        idx.procs[pid] = std::move(l);
+    }
+}
+
+// Expands each root to its subtree or process group, stopping every member
+// (with stop unset, a single snapshot is taken and nobody is signalled).
+// Returns the members (roots included) as list rows; pid 1, ex1 and its
+// ancestors are never included.
+static ProcessList stopProcessTrees(const ProcessList& roots, TreeMode mode, PidfdTable& handles,
+                                   bool stop = true) {
+    ProcessIndex idx;
+    std::vector<pid_t> members;
+    std::unordered_map<pid_t, bool> known;
+    std::vector<pid_t> pgids;
+    for (int pass = 0; pass < 5; ++pass) {
+        buildProcessIndex(idx);
+        if (pass == 0) {
+            for (pid_t a = getpid(); a > 1 && idx.procs.count(a); a = idx.procs[a].ppid) known[a] = false;
+            for (auto &r : roots) {
+                auto it = idx.procs.find(r.pid);
+                if (it != idx.procs.end()) pgids.push_back(it->second.pgid);
+            }
+        }
+        std::vector<pid_t> found;
+        if (mode == TreeSubtree) {
+            std::vector<pid_t> stack;
+            for (auto &r : roots) stack.push_back(r.pid);
+            stack.insert(stack.end(), members.begin(), members.end());
+            while (!stack.empty()) {
+                pid_t pid = stack.back();
+                stack.pop_back();
+                if (!known.count(pid)) found.push_back(pid);
+                auto ch = idx.children.find(pid);
+                if (ch == idx.children.end()) continue;
+                for (pid_t c : ch->second) {
+                    if (!known.count(c) && std::find(found.begin(), found.end(), c) == found.end()) stack.push_back(c);
+                }
+            }
+        } else {
+            for (auto &e : idx.procs) {
+                if (!known.count(e.first) && std::find(pgids.begin(), pgids.end(), e.second.pgid) != pgids.end())
+                    found.push_back(e.first);
+            }
+        }
+        size_t added = 0;
+        for (pid_t pid : found) {
+            if (pid <= 1 || known.count(pid)) continue;
+            known[pid] = true;
+            if (stop) {
+                int pfd = handles.capture(pid);
+                // The index predates pidfd_open: if the member exited and its
+                // pid was reused since, the pidfd pins the newcomer instead.
+                auto it = idx.procs.find(pid);
+                ProcLink now;
+                if (it == idx.procs.end() || !readProcLink(pid, now) || now.starttime != it->second.starttime ||
+                    now.ppid != it->second.ppid || now.pgid != it->second.pgid) {
+                    handles.release(pid);
+                    continue;
+                }
+                if ((pfd >= 0 ? sysPidfdSendSignal(pfd, SIGSTOP) : kill(pid, SIGSTOP)) != 0) continue;   // gone
+            }
+            members.push_back(pid);
+            ++added;
         }
+        if (added == 0 || !stop) break;
     }
-    closedir(d);
-#endif
-    return out;
+
+    ProcessList rows;
+    for (auto &r : roots) {
+        pid_t root = r.pid;
+        size_t n = 0, bytes = 0;
+        auto inTree = [&](pid_t pid) {
+            if (mode == TreeProcessGroup) return idx.procs.count(pid) && idx.procs[pid].pgid == idx.procs[root].pgid;
+            for (pid_t a = pid; a > 1 && idx.procs.count(a); a = idx.procs[a].ppid) if (a == root) return true;
+            return false;
+        };
+        for (pid_t pid : members) if (inTree(pid)) { ++n; bytes += idx.procs[pid].rss; }
+        std::cout << (mode == TreeProcessGroup ? "Process group of PID=" : "Tree of PID=") << root
+                  << " name=" << r.comm << ": " << n << " processes " << (stop ? "stopped" : "in snapshot")
+                  << ", rssMB="
+                  << bytes / 1024 / 1024 << "\n";
+    }
+    for (pid_t pid : members) {
+        const ProcLink& l = idx.procs[pid];
+        rows.push_back(makeProcessRecord(pid, l.comm, l.rss));
+    }
+    return rows;
 }
 
-bool tryTerminateProcess(pid_t pid) {
-    if (kill(pid, SIGTERM) == 0) return true;
-    return false;
+// ---------------------------------------------------------------------------
+// serve: OpenMetrics exporter.
+//
+// A scanner thread runs the same adaptive loop as watch and renders the whole
+// HTTP response once per scan. The main thread runs a non-blocking epoll loop
+// that hands every scrape the latest pre-rendered response, so any number of
+// concurrent scrapes costs zero extra /proc walks.
+// ---------------------------------------------------------------------------
+
+struct ServeOptions {
+    std::string listen = "127.0.0.1:9105";  // host:port, unix:/path or unix:@abstract
+    WatchOptions scan;
+};
+
+static void appendLabelValue(std::string& out, const std::string& v) {
+    for (char c : v) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+}
+
+static std::string renderOpenMetrics(const ScanTick& t) {
+    std::string body;
+    body.reserve(128 + t.procs.size() * 80);
+    body += "# TYPE ex1_process_resident_memory_bytes gauge\n"
+            "# UNIT ex1_process_resident_memory_bytes bytes\n"
+            "# HELP ex1_process_resident_memory_bytes Resident set size of processes above the threshold.\n";
+    for (auto &r : t.procs) {
+        body += "ex1_process_resident_memory_bytes{pid=\"";
+        body += std::to_string(r.pid);
+        body += "\",comm=\"";
+        appendLabelValue(body, r.comm);
+        body += "\"} ";
+        body += std::to_string(r.rss());
+        body += '\n';
+    }
+    body += "# TYPE ex1_memory_available_bytes gauge\n"
+            "# UNIT ex1_memory_available_bytes bytes\n"
+            "ex1_memory_available_bytes " + std::to_string(t.pressure.memAvailableKB * 1024ULL) + "\n";
+    body += "# TYPE ex1_memory_total_bytes gauge\n"
+            "# UNIT ex1_memory_total_bytes bytes\n"
+            "ex1_memory_total_bytes " + std::to_string(t.pressure.memTotalKB * 1024ULL) + "\n";
+    if (t.pressure.psiSomeAvg10 >= 0) {
+        std::ostringstream os;
+        os << "# TYPE ex1_memory_pressure_some_avg10 gauge\n"
+           << "ex1_memory_pressure_some_avg10 " << t.pressure.psiSomeAvg10 << "\n"
+           << "# TYPE ex1_memory_pressure_full_avg10 gauge\n"
+           << "ex1_memory_pressure_full_avg10 " << t.pressure.psiFullAvg10 << "\n";
+        body += os.str();
+    }
+    std::ostringstream os;
+    os << "# TYPE ex1_scan_duration_seconds gauge\n"
+       << "# UNIT ex1_scan_duration_seconds seconds\n"
+       << "ex1_scan_duration_seconds " << t.wallMs / 1000.0 << "\n"
+       << "# TYPE ex1_scan_cpu_seconds gauge\n"
+       << "# UNIT ex1_scan_cpu_seconds seconds\n"
+       << "ex1_scan_cpu_seconds " << t.cpuMs / 1000.0 << "\n"
+       << "# TYPE ex1_scans counter\n"
+       << "ex1_scans_total " << t.seq << "\n"
+       << "# TYPE ex1_scan_timestamp_seconds gauge\n"
+       << "# UNIT ex1_scan_timestamp_seconds seconds\n"
+       << "ex1_scan_timestamp_seconds " << realtimeMs() / 1000 << "\n";
+    body += os.str();
+    appendScanStatsOpenMetrics(body);
+    body += "# EOF\n";
+
+    std::string resp = "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                       "Connection: close\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    resp += body;
+    return resp;
+}
+
+static int openListenSocket(const std::string& spec) {
+    int fd = -1;
+    if (spec.compare(0, 5, "unix:") == 0) {
+        std::string path = spec.substr(5);
+        struct sockaddr_un sun = {};
+        sun.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(sun.sun_path)) return -1;
+        memcpy(sun.sun_path, path.data(), path.size());
+        socklen_t len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path.size());
+        if (path[0] == '@') sun.sun_path[0] = '\0';      // abstract namespace
+        else { unlink(path.c_str()); ++len; }
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (bind(fd, (struct sockaddr*)&sun, len) != 0) { close(fd); return -1; }
+    } else {
+        size_t colon = spec.rfind(':');
+        if (colon == std::string::npos) return -1;
+        struct sockaddr_in sin = {};
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons((uint16_t)std::stoul(spec.substr(colon + 1)));
+        if (inet_pton(AF_INET, spec.substr(0, colon).c_str(), &sin.sin_addr) != 1) return -1;
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr*)&sin, sizeof(sin)) != 0) { close(fd); return -1; }
+    }
+    if (listen(fd, 128) != 0) { close(fd); return -1; }
+    return fd;
 }
 
+int runServe(const ServeOptions& opts) {
+    installStopHandlers();
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = openListenSocket(opts.listen);
+    if (lfd < 0) {
+        std::cerr << "Cannot listen on " << opts.listen << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::shared_ptr<const std::string> latest = std::make_shared<const std::string>(
+        "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    bool stopping = false;
+
+    std::thread scanner([&]() {
+        ScanLoop loop(opts.scan);
+        ScanTick t;
+        std::unique_lock<std::mutex> lk(mu);
+        while (!stopping) {
+            lk.unlock();
+            loop.scan(t);
+            uint64_t out0 = monotonicNs();
+            auto rendered = std::make_shared<const std::string>(renderOpenMetrics(t));
+            recordScanPhase(PhaseOutput, monotonicNs() - out0);
+            lk.lock();
+            latest = rendered;
+            cv.wait_for(lk, std::chrono::milliseconds(t.sleepMs), [&]() { return stopping; });
+        }
+    });
+
+    struct Conn {
+        std::string in;
+        std::shared_ptr<const std::string> out;   // pins the snapshot being sent
+        size_t sent = 0;
+        double openedAt = 0;
+    };
+    std::unordered_map<int, Conn> conns;
+    const size_t kMaxConns = 256, kMaxRequest = 8192;
+    const double kConnTimeoutMs = 10000;
+    const std::string notFound = "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+    std::cerr << "Serving OpenMetrics on " << opts.listen << " (/metrics)\n";
+    struct epoll_event events[64];
+    while (!g_watchStop) {
+        int n = epoll_wait(ep, events, 64, 1000);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == lfd) {
+                int c;
+                while ((c = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    if (conns.size() >= kMaxConns) { close(c); continue; }
+                    struct epoll_event cev = {};
+                    cev.events = EPOLLIN | EPOLLRDHUP;
+                    cev.data.fd = c;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, c, &cev);
+                    conns[c].openedAt = monotonicMs();
+                }
+                continue;
+            }
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            Conn& cn = it->second;
+            bool done = false;
+            if (!cn.out) {
+                char buf[2048];
+                ssize_t r;
+                while ((r = read(fd, buf, sizeof(buf))) > 0) cn.in.append(buf, (size_t)r);
+                if (r == 0 || (r < 0 && errno != EAGAIN) || cn.in.size() > kMaxRequest) {
+                    done = true;
+                } else if (cn.in.find("\r\n\r\n") != std::string::npos) {
+                    // Only the request line matters: "GET /metrics?query HTTP/1.1".
+                    // The path runs up to the first '?' or space.
+                    bool metrics = false;
+                    if (cn.in.compare(0, 4, "GET ") == 0) {
+                        size_t end = cn.in.find_first_of("? \r\n", 4);
+                        std::string path = cn.in.substr(4, end == std::string::npos ? std::string::npos : end - 4);
+                        metrics = path == "/metrics" || path == "/";
+                    }
+                    if (metrics) {
+                        std::lock_guard<std::mutex> lk(mu);
+                        cn.out = latest;
+                    } else {
+                        cn.out = std::make_shared<const std::string>(notFound);
+                    }
+                    struct epoll_event cev = {};
+                    cev.events = EPOLLOUT | EPOLLRDHUP;
+                    cev.data.fd = fd;
+                    epoll_ctl(ep, EPOLL_CTL_MOD, fd, &cev);
+                }
+            }
+            if (!done && cn.out) {
+                while (cn.sent < cn.out->size()) {
+                    ssize_t w = write(fd, cn.out->data() + cn.sent, cn.out->size() - cn.sent);
+                    if (w < 0) { if (errno != EAGAIN) done = true; break; }
+                    cn.sent += (size_t)w;
+                }
+                if (cn.sent == cn.out->size()) done = true;
+            }
+            if (done) { close(fd); conns.erase(it); }
+        }
+        // Drop slow or stuck clients.
+        double now = monotonicMs();
+        for (auto it = conns.begin(); it != conns.end();) {
+            if (now - it->second.openedAt > kConnTimeoutMs) { close(it->first); it = conns.erase(it); }
+            else ++it;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mu);
+        stopping = true;
+    }
+    cv.notify_all();
+    scanner.join();
+    for (auto &c : conns) close(c.first);
+    close(ep);
+    close(lfd);
+    if (opts.listen.compare(0, 5, "unix:") == 0 && opts.listen.size() > 5 && opts.listen[5] != '@')
+        unlink(opts.listen.c_str() + 5);
+    return 0;
+}
 #endif
 
 // Interactive menu: 1=free memory, 2=handle processes, 3=both, 4=exit
@@ -208,15 +3604,16 @@ void runInteractiveMenu() {
                 }
             }
 #else
-            auto procs = listHighMemoryProcesses(threshold);
+            PidfdTable handles;
+            KillPlan plan{VictimPolicy()};
+            auto procs = listHighMemoryProcesses(threshold, doKill ? &handles : nullptr, doKill ? &plan : nullptr);
+            if (doKill) {
+                plan.finish();
+                terminateListed(printKillPlan(plan), handles, 5000);
+                continue;
+            }
             for (auto &t : procs) {
-                pid_t pid; std::string name; size_t rss;
-                std::tie(pid, name, rss) = t;
-                std::cout << " PID=" << pid << " name=" << name << " rssMB=" << (rss / 1024 / 1024) << "\n";
-                if (doKill) {
-                    std::cout << "  Intentando terminar PID " << pid << " ... ";
-                    if (tryTerminateProcess(pid)) std::cout << "OK\n"; else std::cout << "FAILED\n";
-                }
+                std::cout << " PID=" << t.pid << " name=" << t.comm << " rssMB=" << (t.rssKB / 1024) << "\n";
             }
 #endif
         }
@@ -238,22 +3635,151 @@ int main(int argc, char** argv) {
     }
     // Uso:
     // ex1.exe trim                       -> recorta el working set del proceso actual
+    // ex1.exe trim --pid <pid> [--stats] -> pide al agente LD_PRELOAD de <pid> que recorte su heap
+    //                                       (o que informe del recortador en segundo plano) (Linux)
+    // ex1.exe trim [--pid <pid>] --arenas N [--budget ms] [--min-free KB]
+    //                                    -> recorta solo las N arenas con mas memoria libre, con
+    //                                       presupuesto de pausa; informa pausa frente a bytes
     // ex1.exe list <thresholdMB>         -> lista procesos que usan >= thresholdMB
-    // ex1.exe list <thresholdMB> --kill  -> intenta terminar esos procesos (USE CON CUIDADO)
+    //           [--top N] [--cmdline [--max-len N]] [--owner]
+    //                                    -> solo los N mayores; cmdline, exe y cwd de las filas
+    //                                       mostradas, recortados a N bytes; usuario y contenedor
+    //                                       (--cmdline/--owner: POSIX)
+    //           [--sort rss|pss|swap|growth|name[,...]] [--growth-ms ms]
+    //                                    -> orden de las filas (por defecto rss, mayor primero);
+    //                                       claves secundarias separadas por comas; growth mide
+    //                                       el RSS dos veces con ms de separacion (un proceso
+    //                                       nuevo cuenta todo su RSS)
+    // ex1.exe list <thresholdMB> --kill [--grace ms]
+    //                                    -> intenta terminar esos procesos (USE CON CUIDADO);
+    //                                       SIGKILL a los que sigan vivos tras la gracia (POSIX)
+    //           [--protect comm,...] [--allow-root] [--uid N] [--cgroup prefix]
+    //           [--protect-cgroup prefix] [--pss] [--min-age s] [--age-weight w]
+    //                                    -> politica de seleccion de victimas y orden del plan (POSIX)
+    // ex1 list <thresholdMB> --freeze [--freeze-timeout s]
+    //                                    -> congela (cgroup.freeze o SIGSTOP); SIGKILL si no se
+    //                                       descongela antes del timeout (Linux)
+    // ex1 thaw <pid>...                  -> deshace --freeze (Linux)
+    // ex1 list <thresholdMB> --kill-tree | --kill-pgid
+    //                                    -> detiene y mata el subarbol / grupo de procesos entero (Linux)
+    // ex1 list <thresholdMB> --kill... --dry-run [--pagemap]
+    //                                    -> muestra el plan y la memoria que se liberaria, sin senales (Linux)
     // ex1.exe alt                        -> ejecuta "alternate_main"
+    // ex1 watch <thresholdMB> [--interval ms] [--min-interval ms] [--max-interval ms]
+    //           [--cpu-budget pct] [--count N] [--delta [--epsilon MB]] [--record file]
+    //           [--cgroup-reclaim MB [--cgroup-top K] [--cgroup-every s] [--cgroup-psi-max pct]]
+    //           [--cmdline [--max-len N]] [--owner] [--sort keys]
+    //                                    -> reescanea con intervalo adaptativo (Linux); growth
+    //                                       compara con el escaneo anterior (un proceso que no
+    //                                       estaba cuenta todo su RSS como crecimiento)
+    // ex1 query <file> --pid N | --comm name [--from s] [--to s]
+    // ex1 query <file> --top N [--at s]  -> consulta el historial grabado con --record
+    // ex1 stats [--threshold MB] [--count N] [--interval ms]
+    //                                    -> latencias por fase, syscalls y asignaciones del escaneo
+    // ex1 reclaim --target MB [--min-size MB] [--grace ms] [--dry-run] [opciones de politica]
+    //                                    -> libera MB con el menor numero de victimas (Linux)
+    // ex1 pageout <pid>... | --top N [--threshold MB] [--cold]
+    //                                    -> envia la memoria anonima a swap/zram sin matar (Linux)
+    // ex1 cgroup-reclaim <path> <MB> [--step MB] [--pause ms]
+    //                                    -> reclama MB de un cgroup v2 via memory.reclaim (Linux)
+    // ex1 serve [--listen 127.0.0.1:9105|unix:/path] [--threshold MB] [--interval ms] ...
+    //                                    -> exporta OpenMetrics en /metrics (Linux)
 
     if (argc >= 2) {
         std::string cmd = argv[1];
         if (cmd == "trim") {
+            long pid = 0;
+            bool stats = false, targeted = false;
+            ex1::ArenaTrimOptions ao;
+            for (int i = 2; i < argc; ++i) {
+                std::string a = argv[i];
+                if (a == "--pid" && i + 1 < argc) pid = std::stol(argv[++i]);
+                else if (a == "--stats") stats = true;
+                else if (a == "--arenas" && i + 1 < argc) { targeted = true; ao.maxArenas = (unsigned)std::stoul(argv[++i]); }
+                else if (a == "--budget" && i + 1 < argc) { targeted = true; ao.budgetMs = std::stod(argv[++i]); }
+                else if (a == "--min-free" && i + 1 < argc) { targeted = true; ao.minFreeKB = std::stoull(argv[++i]); }
+            }
+#ifdef __linux__
+            if (pid > 0) {
+                std::string what = stats ? "stats" : "trim";
+                if (targeted && !stats) {
+                    char req[96];
+                    snprintf(req, sizeof(req), "trim-arenas %u %g %llu", ao.maxArenas, ao.budgetMs,
+                             (unsigned long long)ao.minFreeKB);
+                    what = req;
+                }
+                return trimRemoteProcess((pid_t)pid, what);
+            }
+#endif
+            if (targeted) return trimArenasOfCurrentProcess(ao);
             trimCurrentProcessWorkingSet();
             return 0;
         } else if (cmd == "list" && argc >= 3) {
             size_t threshold = std::stoul(argv[2]);
             bool doKill = false;
-            if (argc >= 4 && std::string(argv[3]) == "--kill") doKill = true;
+            unsigned graceMs = 5000;
+            size_t topN = 0;
+            std::vector<SortKey> sortKeys{SortRss};
+            unsigned growthMs = 1000;
+#ifndef _WIN32
+            VictimPolicy policy;
+            bool showDetails = false, showOwner = false;
+            size_t maxLen = 256;
+#endif
+#ifdef __linux__
+            bool doFreeze = false;
+            unsigned freezeTimeoutSec = 0;
+            bool killTree = false, killPgid = false;
+            bool dryRun = false, pagemap = false;
+#endif
+            for (int i = 3; i < argc; ++i) {
+                std::string a = argv[i];
+                if (a == "--kill") doKill = true;
+                else if (a == "--grace" && i + 1 < argc) graceMs = std::stoul(argv[++i]);
+                else if (a == "--top" && i + 1 < argc) topN = std::stoul(argv[++i]);
+                else if (a == "--sort" && i + 1 < argc) {
+                    if (!parseSortKeys(argv[++i], sortKeys)) {
+                        std::cerr << "--sort takes rss, pss, swap, growth and name, comma-separated\n";
+                        return 1;
+                    }
+                }
+                else if (a == "--growth-ms" && i + 1 < argc) growthMs = std::stoul(argv[++i]);
+#ifndef _WIN32
+                else if (a == "--cmdline") showDetails = true;
+                else if (a == "--owner") showOwner = true;
+                else if (a == "--max-len" && i + 1 < argc) maxLen = std::stoul(argv[++i]);
+#endif
+#ifdef __linux__
+                else if (a == "--freeze") doFreeze = true;
+                else if (a == "--freeze-timeout" && i + 1 < argc) freezeTimeoutSec = std::stoul(argv[++i]);
+                else if (a == "--kill-tree") killTree = doKill = true;
+                else if (a == "--kill-pgid") killPgid = doKill = true;
+                else if (a == "--dry-run") dryRun = true;
+                else if (a == "--pagemap") pagemap = true;
+#endif
+#ifndef _WIN32
+                else if (parsePolicyOption(argc, argv, i, policy)) {}
+#endif
+                else { std::cerr << "Unknown list option: " << a << "\n"; return 1; }
+            }
 
 #ifdef _WIN32
             auto procs = listHighMemoryProcesses(threshold);
+            (void)growthMs;
+            // No smaps here: pss, swap and growth fall back to the working set.
+            std::stable_sort(procs.begin(), procs.end(),
+                             [&](const std::tuple<DWORD, std::string, SIZE_T>& x,
+                                 const std::tuple<DWORD, std::string, SIZE_T>& y) {
+                                 for (SortKey k : sortKeys) {
+                                     if (k == SortName) {
+                                         if (std::get<1>(x) != std::get<1>(y)) return std::get<1>(x) < std::get<1>(y);
+                                     } else if (std::get<2>(x) != std::get<2>(y)) {
+                                         return std::get<2>(x) > std::get<2>(y);
+                                     }
+                                 }
+                                 return std::get<0>(x) < std::get<0>(y);
+                             });
+            if (topN > 0 && procs.size() > topN) procs.resize(topN);
             if (procs.empty()) {
                 std::cout << "No processes found using >= " << threshold << " MB\n";
             }
@@ -267,18 +3793,77 @@ int main(int argc, char** argv) {
                 }
             }
 #else
-            auto procs = listHighMemoryProcesses(threshold);
+            // When killing, hold a pidfd per candidate so signals reach the measured
+            // process, and let the victim policy decide who goes and in which order.
+            PidfdTable handles;
+            KillPlan plan(policy);
+            ProcessDetailsCache detailCache(maxLen);
+            OwnerResolver owner;
+            RowExtras extras;
+            if (showDetails) extras.details = &detailCache;
+            if (showOwner) extras.owner = &owner;
+#ifdef __linux__
+            if (doFreeze && doKill) {
+                std::cerr << "--kill and --freeze are exclusive\n";
+                return 1;
+            }
+            if (dryRun) {
+                if (!doKill) {
+                    std::cerr << "--dry-run needs --kill, --kill-tree or --kill-pgid\n";
+                    return 1;
+                }
+                // No pidfds and no signals: the plan, the trees and the prediction only.
+                listHighMemoryProcesses(threshold, nullptr, &plan);
+                plan.finish();
+                auto victims = printKillPlan(plan, extras);
+                if (killTree || killPgid)
+                    victims = stopProcessTrees(victims, killPgid ? TreeProcessGroup : TreeSubtree, handles, false);
+                printFreedPrediction(victims, pagemap);
+                return 0;
+            }
+            if (doFreeze) {
+                // Same victim selection as --kill; the action is a freeze.
+                listHighMemoryProcesses(threshold, &handles, &plan);
+                plan.finish();
+                if (plan.victims().empty() && plan.skipped().empty())
+                    std::cout << "No processes found using >= " << threshold << " MB\n";
+                return freezeListed(printKillPlan(plan, extras), handles, freezeTimeoutSec);
+            }
+#endif
+            auto procs = listHighMemoryProcesses(threshold, doKill ? &handles : nullptr, doKill ? &plan : nullptr);
+            if (doKill) {
+                plan.finish();
+                if (plan.victims().empty() && plan.skipped().empty())
+                    std::cout << "No processes found using >= " << threshold << " MB\n";
+                auto victims = printKillPlan(plan, extras);
+#ifdef __linux__
+                if (killTree || killPgid) {
+                    // Everyone is stopped already, so go straight to SIGKILL.
+                    terminateListed(stopProcessTrees(victims, killPgid ? TreeProcessGroup : TreeSubtree, handles),
+                                    handles, 0);
+                    return 0;
+                }
+#endif
+                // SIGTERM to all at once, SIGKILL to whoever outlives the grace period.
+                terminateListed(victims, handles, graceMs);
+                return 0;
+            }
+            std::unordered_map<int32_t, uint32_t> previous;
+            if (std::find(sortKeys.begin(), sortKeys.end(), SortGrowth) != sortKeys.end()) {
+                // Growth needs a window: the scan above is the baseline, measure again.
+                for (auto &r : procs) previous[r.pid] = r.rssKB;
+                std::this_thread::sleep_for(std::chrono::milliseconds(growthMs));
+                procs = listHighMemoryProcesses(threshold);
+            }
+            sortProcessList(procs, sortKeys, previous);
+            if (topN > 0 && procs.size() > topN) procs.resize(topN);
             if (procs.empty()) {
                 std::cout << "No processes found using >= " << threshold << " MB\n";
             }
             for (auto &t : procs) {
-                pid_t pid; std::string name; size_t rss;
-                std::tie(pid, name, rss) = t;
-                std::cout << "PID=" << pid << " name=" << name << " rssMB=" << (rss / 1024 / 1024) << "\n";
-                if (doKill) {
-                    std::cout << "  Attempting to terminate PID " << pid << " ... ";
-                    if (tryTerminateProcess(pid)) std::cout << "OK\n"; else std::cout << "FAILED\n";
-                }
+                std::cout << "PID=" << t.pid << " name=" << t.comm << " rssMB=" << (t.rssKB / 1024);
+                printRowExtras(std::cout, extras, t.pid);
+                std::cout << "\n";
             }
 #endif
             return 0;
@@ -286,11 +3871,175 @@ int main(int argc, char** argv) {
             alternate_main();
             return 0;
         }
+#ifdef __linux__
+        else if (cmd == "watch" && argc >= 3) {
+            WatchOptions opts;
+            opts.thresholdMB = std::stoul(argv[2]);
+            for (int i = 3; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--interval" && hasValue) opts.baseIntervalMs = std::stoul(argv[++i]);
+                else if (a == "--min-interval" && hasValue) opts.minIntervalMs = std::stoul(argv[++i]);
+                else if (a == "--max-interval" && hasValue) opts.maxIntervalMs = std::stoul(argv[++i]);
+                else if (a == "--cpu-budget" && hasValue) opts.cpuBudgetPct = std::stod(argv[++i]);
+                else if (a == "--count" && hasValue) opts.maxScans = std::stoul(argv[++i]);
+                else if (a == "--delta") opts.deltaOnly = true;
+                else if (a == "--epsilon" && hasValue) opts.epsilonMB = std::stoul(argv[++i]);
+                else if (a == "--record" && hasValue) opts.recordPath = argv[++i];
+                else if (a == "--cgroup-reclaim" && hasValue) opts.cgroupReclaimMB = std::stoul(argv[++i]);
+                else if (a == "--cgroup-top" && hasValue) opts.cgroupTop = std::stoul(argv[++i]);
+                else if (a == "--cgroup-every" && hasValue) opts.cgroupEverySec = std::stoul(argv[++i]);
+                else if (a == "--cgroup-psi-max" && hasValue) opts.cgroupPsiMax = std::stod(argv[++i]);
+                else if (a == "--cmdline") opts.showDetails = true;
+                else if (a == "--owner") opts.showOwner = true;
+                else if (a == "--sort" && hasValue) {
+                    if (!parseSortKeys(argv[++i], opts.sortKeys)) {
+                        std::cerr << "--sort takes rss, pss, swap, growth and name, comma-separated\n";
+                        return 1;
+                    }
+                }
+                else if (a == "--max-len" && hasValue) opts.detailMaxLen = std::stoul(argv[++i]);
+                else { std::cerr << "Unknown watch option: " << a << "\n"; return 1; }
+            }
+            if (opts.minIntervalMs > opts.baseIntervalMs) opts.minIntervalMs = opts.baseIntervalMs;
+            if (opts.maxIntervalMs < opts.baseIntervalMs) opts.maxIntervalMs = opts.baseIntervalMs;
+            return runWatch(opts);
+        } else if (cmd == "query" && argc >= 3) {
+            QueryOptions q;
+            q.file = argv[2];
+            for (int i = 3; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--pid" && hasValue) q.pid = std::stoll(argv[++i]);
+                else if (a == "--comm" && hasValue) q.comm = argv[++i];
+                else if (a == "--top" && hasValue) q.topN = std::stoul(argv[++i]);
+                else if (a == "--at" && hasValue) q.atMs = std::stoll(argv[++i]) * 1000;
+                else if (a == "--from" && hasValue) q.fromMs = std::stoll(argv[++i]) * 1000;
+                else if (a == "--to" && hasValue) q.toMs = std::stoll(argv[++i]) * 1000;
+                else { std::cerr << "Unknown query option: " << a << "\n"; return 1; }
+            }
+            if (q.pid < 0 && q.comm.empty() && q.topN == 0) {
+                std::cerr << "query needs --pid, --comm or --top\n";
+                return 1;
+            }
+            return runQuery(q);
+        } else if (cmd == "stats") {
+            WatchOptions opts;
+            opts.maxScans = 20;
+            opts.baseIntervalMs = 0;
+            for (int i = 2; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--threshold" && hasValue) opts.thresholdMB = std::stoul(argv[++i]);
+                else if (a == "--count" && hasValue) opts.maxScans = std::stoul(argv[++i]);
+                else if (a == "--interval" && hasValue) opts.baseIntervalMs = std::stoul(argv[++i]);
+                else { std::cerr << "Unknown stats option: " << a << "\n"; return 1; }
+            }
+            return runStats(opts);
+        } else if (cmd == "reclaim") {
+            ReclaimOptions ro;
+            for (int i = 2; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--target" && hasValue) ro.targetMB = std::stoul(argv[++i]);
+                else if (a == "--min-size" && hasValue) ro.minSizeMB = std::stoul(argv[++i]);
+                else if (a == "--grace" && hasValue) ro.graceMs = std::stoul(argv[++i]);
+                else if (a == "--dry-run") ro.dryRun = true;
+                else if (parsePolicyOption(argc, argv, i, ro.policy)) {}
+                else { std::cerr << "Unknown reclaim option: " << a << "\n"; return 1; }
+            }
+            if (ro.targetMB == 0) {
+                std::cerr << "reclaim needs --target MB\n";
+                return 1;
+            }
+            return runReclaim(ro);
+        } else if (cmd == "pageout" && argc >= 3) {
+            PageoutOptions po;
+            for (int i = 2; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--top" && hasValue) po.topN = std::stoul(argv[++i]);
+                else if (a == "--threshold" && hasValue) po.thresholdMB = std::stoul(argv[++i]);
+                else if (a == "--cold") po.advice = MADV_COLD;
+                else if (!a.empty() && a[0] >= '0' && a[0] <= '9') po.pids.push_back((pid_t)std::stol(a));
+                else { std::cerr << "Unknown pageout option: " << a << "\n"; return 1; }
+            }
+            if (po.pids.empty() == (po.topN == 0)) {
+                std::cerr << "pageout needs pids or --top N\n";
+                return 1;
+            }
+            return runPageout(po);
+        } else if (cmd == "cgroup-reclaim" && argc >= 4) {
+            CgroupReclaimOptions co;
+            co.path = argv[2];
+            co.mb = std::stoul(argv[3]);
+            for (int i = 4; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--step" && hasValue) co.stepMB = std::stoul(argv[++i]);
+                else if (a == "--pause" && hasValue) co.pauseMs = std::stoul(argv[++i]);
+                else { std::cerr << "Unknown cgroup-reclaim option: " << a << "\n"; return 1; }
+            }
+            return runCgroupReclaim(co);
+        } else if (cmd == "thaw" && argc >= 3) {
+            std::vector<pid_t> pids;
+            for (int i = 2; i < argc; ++i) pids.push_back((pid_t)std::stol(argv[i]));
+            return runThaw(pids);
+        } else if (cmd == "serve") {
+            ServeOptions so;
+            for (int i = 2; i < argc; ++i) {
+                std::string a = argv[i];
+                bool hasValue = i + 1 < argc;
+                if (a == "--listen" && hasValue) so.listen = argv[++i];
+                else if (a == "--threshold" && hasValue) so.scan.thresholdMB = std::stoul(argv[++i]);
+                else if (a == "--interval" && hasValue) so.scan.baseIntervalMs = std::stoul(argv[++i]);
+                else if (a == "--min-interval" && hasValue) so.scan.minIntervalMs = std::stoul(argv[++i]);
+                else if (a == "--max-interval" && hasValue) so.scan.maxIntervalMs = std::stoul(argv[++i]);
+                else if (a == "--cpu-budget" && hasValue) so.scan.cpuBudgetPct = std::stod(argv[++i]);
+                else { std::cerr << "Unknown serve option: " << a << "\n"; return 1; }
+            }
+            if (so.scan.minIntervalMs > so.scan.baseIntervalMs) so.scan.minIntervalMs = so.scan.baseIntervalMs;
+            if (so.scan.maxIntervalMs < so.scan.baseIntervalMs) so.scan.maxIntervalMs = so.scan.baseIntervalMs;
+            return runServe(so);
+        }
+#endif
     }
 
     std::cout << "Usage:\n";
     std::cout << "  " << argv[0] << " trim\n";
-    std::cout << "  " << argv[0] << " list <thresholdMB> [--kill]\n";
+#ifdef __linux__
+    std::cout << "  " << argv[0] << " trim --pid <pid> [--stats]   (needs LD_PRELOAD=libex1trim_agent.so in <pid>)\n";
+#endif
+    std::cout << "  " << argv[0] << " trim [--pid <pid>] --arenas N [--budget ms] [--min-free KB]\n";
+    std::cout << "  " << argv[0] << " list <thresholdMB> [--kill [--grace ms]] [--top N]\n";
+#ifndef _WIN32
+    std::cout << "      rows: [--cmdline [--max-len N]] [--owner]   (also for watch)\n";
+#endif
+    std::cout << "      order: [--sort rss|pss|swap|growth|name[,...]] [--growth-ms ms]   (--sort also for watch)\n";
+#ifdef __linux__
+    std::cout << "  " << argv[0] << " list <thresholdMB> --freeze [--freeze-timeout s]\n";
+    std::cout << "  " << argv[0] << " list <thresholdMB> --kill-tree | --kill-pgid\n";
+    std::cout << "  " << argv[0] << " list <thresholdMB> --kill|--kill-tree|--kill-pgid --dry-run [--pagemap]\n";
+#endif
+#ifndef _WIN32
+    std::cout << "      policy: [--protect comm,...] [--allow-root] [--uid N] [--cgroup prefix]"
+                 " [--protect-cgroup prefix] [--pss] [--min-age s] [--age-weight perDay]\n";
+#endif
     std::cout << "  " << argv[0] << " alt\n";
+#ifdef __linux__
+    std::cout << "  " << argv[0] << " watch <thresholdMB> [--interval ms] [--min-interval ms]"
+                 " [--max-interval ms] [--cpu-budget pct] [--count N] [--delta [--epsilon MB]]"
+                 " [--record file] [--cgroup-reclaim MB [--cgroup-top K] [--cgroup-every s]"
+                 " [--cgroup-psi-max pct]] [--cmdline [--max-len N]] [--owner]\n";
+    std::cout << "  " << argv[0] << " query <file> (--pid N | --comm name) [--from epochSec] [--to epochSec]\n";
+    std::cout << "  " << argv[0] << " query <file> --top N [--at epochSec]\n";
+    std::cout << "  " << argv[0] << " stats [--threshold MB] [--count N] [--interval ms]\n";
+    std::cout << "  " << argv[0] << " reclaim --target MB [--min-size MB] [--grace ms] [--dry-run] [policy options]\n";
+    std::cout << "  " << argv[0] << " pageout (<pid>... | --top N [--threshold MB]) [--cold]\n";
+    std::cout << "  " << argv[0] << " cgroup-reclaim <path> <MB> [--step MB] [--pause ms]\n";
+    std::cout << "  " << argv[0] << " thaw <pid>...\n";
+    std::cout << "  " << argv[0] << " serve [--listen host:port|unix:/path|unix:@name] [--threshold MB]"
+                 " [--interval ms] [--min-interval ms] [--max-interval ms] [--cpu-budget pct]\n";
+#endif
     return 1;
 }
@@ -0,0 +1,184 @@
+// Agente para LD_PRELOAD: permite que `ex1 trim --pid <pid>` pida a un proceso
+// ajeno (que no se puede re-enlazar) que recorte su propio heap.
+//
+//   LD_PRELOAD=/path/libex1trim_agent.so some-service
+//
+// The agent listens on the abstract unix socket "@ex1trim.<pid>" from a
+// thread with every signal blocked, so the host's signal handling is left
+// alone. A socket rather than a realtime signal because the trim cannot run
+// inside a signal handler anyway and the caller gets the result back.
+// Requests are one line, answered with one line:
+//   "trim"  -> "ok allocator=glibc rss_before_kb=.. rss_after_kb=.. released_kb=.. wall_ms=.. cpu_ms=.."
+//   "stats" -> "ok running=.. checks=.. trims=.. rate_limited=.. released_kb=.. max_trim_ms=.."
+//   "trim-arenas <max> <budget_ms> <min_free_kb>"
+//           -> "ok allocator=.. released_kb=.. pause_ms=.. predicted_ms=.. [skipped=..]
+//               arena=<nr>:<free_kb>:<released_kb>:<pause_ms>:<trimmed> ..." (top 8 arenas;
+//               nr -1 is glibc's trim of every arena)
+// Only peers with the same uid (or root) are served. EX1TRIM_BACKGROUND=1
+// also starts the background trimmer with its defaults; EX1TRIM_DISABLE=1
+// turns the agent off. A child that execs inherits LD_PRELOAD and gets its
+// own agent from the new image; EX1TRIM_CHILDREN=1 also serves children that
+// fork without exec (pre-fork servers).
+
+#include "trimmer.h"
+
+#ifdef __linux__
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+int g_listenFd = -1;
+
+int formatReply(const char* cmd, char* out, size_t cap) {
+    if (std::strcmp(cmd, "trim") == 0) {
+        ex1::TrimResult r;
+        if (!ex1::trimNow(r)) return std::snprintf(out, cap, "error no trim available\n");
+        return std::snprintf(out, cap,
+                             "ok allocator=%s rss_before_kb=%llu rss_after_kb=%llu released_kb=%llu "
+                             "wall_ms=%.3f cpu_ms=%.3f\n",
+                             r.allocator, (unsigned long long)r.rssBeforeKB, (unsigned long long)r.rssAfterKB,
+                             (unsigned long long)r.releasedKB, r.wallMs, r.cpuMs);
+    }
+    if (std::strcmp(cmd, "stats") == 0) {
+        ex1::BackgroundTrimStats s = ex1::backgroundTrimmerStats();
+        unsigned long long trims = 0;
+        for (int i = 0; i < ex1::TrimReasonCount; ++i) trims += s.trims[i];
+        return std::snprintf(out, cap,
+                             "ok running=%d checks=%llu trims=%llu rate_limited=%llu released_kb=%llu "
+                             "max_trim_ms=%.3f\n",
+                             s.running ? 1 : 0, (unsigned long long)s.checks, trims,
+                             (unsigned long long)s.rateLimited, (unsigned long long)s.releasedKB, s.maxTrimMs);
+    }
+    if (std::strncmp(cmd, "trim-arenas", 11) == 0) {
+        ex1::ArenaTrimOptions opts;
+        unsigned maxArenas = opts.maxArenas;
+        unsigned long long minFree = opts.minFreeKB;
+        std::sscanf(cmd + 11, "%u %lf %llu", &maxArenas, &opts.budgetMs, &minFree);
+        opts.maxArenas = maxArenas;
+        opts.minFreeKB = minFree;
+        ex1::ArenaTrimResult r;
+        if (!ex1::trimArenas(opts, r)) return std::snprintf(out, cap, "error no trim available\n");
+        int n = std::snprintf(out, cap, "ok allocator=%s released_kb=%llu pause_ms=%.3f predicted_ms=%.3f",
+                              r.allocator, (unsigned long long)r.releasedKB, r.pauseMs, r.predictedMs);
+        if (r.skipped && n > 0 && (size_t)n < cap) {
+            n += std::snprintf(out + n, cap - n, " skipped=");
+            for (const char* p = r.skipped; *p && (size_t)n + 1 < cap; ++p) out[n++] = *p == ' ' ? '_' : *p;
+            out[n] = '\0';
+        }
+        for (size_t i = 0; i < r.arenas.size() && i < 8 && n > 0 && (size_t)n < cap; ++i) {
+            const ex1::ArenaTrimEntry& e = r.arenas[i];
+            n += std::snprintf(out + n, cap - n, " arena=%d:%llu:%llu:%.3f:%d", e.arena,
+                               (unsigned long long)e.freeKB, (unsigned long long)e.releasedKB, e.pauseMs,
+                               e.trimmed ? 1 : 0);
+        }
+        if (n > 0 && (size_t)n + 1 < cap) { out[n++] = '\n'; out[n] = '\0'; }
+        return n;
+    }
+    return std::snprintf(out, cap, "error unknown command\n");
+}
+
+void serveClient(int fd) {
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) != 0 ||
+        (cred.uid != 0 && cred.uid != getuid())) {
+        return;
+    }
+    struct timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char cmd[64];
+    size_t n = 0;
+    while (n + 1 < sizeof(cmd)) {
+        ssize_t r = read(fd, cmd + n, sizeof(cmd) - 1 - n);
+        if (r <= 0) break;
+        n += (size_t)r;
+        if (memchr(cmd, '\n', n)) break;
+    }
+    cmd[n] = '\0';
+    cmd[strcspn(cmd, "\r\n")] = '\0';
+    char reply[1024];
+    int len = formatReply(cmd, reply, sizeof(reply));
+    if (len > 0) send(fd, reply, std::min((size_t)len, sizeof(reply) - 1), MSG_NOSIGNAL);
+}
+
+void* agentLoop(void* arg) {
+    int lfd = (int)(intptr_t)arg;
+    for (;;) {
+        int fd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return nullptr;
+        }
+        serveClient(fd);
+        close(fd);
+    }
+}
+
+void startAgent() {
+    struct sockaddr_un sun = {};
+    sun.sun_family = AF_UNIX;
+    int nameLen = std::snprintf(sun.sun_path + 1, sizeof(sun.sun_path) - 1, "ex1trim.%d", (int)getpid());
+    socklen_t len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + nameLen);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+    if (bind(fd, (struct sockaddr*)&sun, len) != 0 || listen(fd, 4) != 0) {
+        close(fd);
+        return;
+    }
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);   // the new thread inherits "all blocked"
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    pthread_t t;
+    if (pthread_create(&t, &attr, agentLoop, (void*)(intptr_t)fd) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    g_listenFd = fd;
+}
+
+bool g_serveChildren = false;
+
+// A forked child inherits the parent's socket but not the thread serving it:
+// drop the parent's. Listening under the child's own pid costs a thread and a
+// socket that a fork+exec child throws away at once, so only on request.
+void restartInChild() {
+    if (g_listenFd >= 0) close(g_listenFd);
+    g_listenFd = -1;
+    if (g_serveChildren) startAgent();
+}
+
+bool envFlag(const char* name) {
+    const char* v = getenv(name);
+    return v && *v && std::strcmp(v, "0") != 0;
+}
+
+__attribute__((constructor)) void agentInit() {
+    if (envFlag("EX1TRIM_DISABLE")) return;
+    g_serveChildren = envFlag("EX1TRIM_CHILDREN");
+    startAgent();
+    pthread_atfork(nullptr, nullptr, restartInChild);
+    // Safe to run in an arbitrary host only because the trimmer's state
+    // survives exit() and is rebuilt in forked children.
+    if (envFlag("EX1TRIM_BACKGROUND")) ex1::startBackgroundTrimmer();
+}
+
+} // namespace
+#endif
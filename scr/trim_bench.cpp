@@ -0,0 +1,293 @@
+// Banco de pruebas de fragmentación para la ruta de recorte: construye patrones
+// de heap reproducibles y mide cuánto RSS devuelve el recorte, cuánto tarda y
+// cuánto cuestan los fallos de página al volver a asignar.
+//
+//   ex1_trimbench [--mb N] [--threads N] [--repeat N] [--seed N] [pattern...]
+//
+// Each pattern runs in a fresh forked child, twice: once with a trim and once
+// without, so the refault cost of the trim can be told apart from the normal
+// cost of growing the heap again. Patterns:
+//   small-frees   many 16..512 byte blocks, 90% freed at random
+//   large-churn   16..120 KB blocks (below the mmap threshold) allocated and
+//                 freed in rounds, 10% survivors
+//   arena-spread  the small-frees pattern on N threads (one arena each)
+//   top-pinned    everything freed except the most recent block, which pins
+//                 the top of the heap
+// Columns: RSS after building the pattern, RSS released by trimNow(), trim
+// wall/CPU time, then time and minor faults to allocate and touch the freed
+// volume again, with trim and without.
+
+#include "trimmer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+namespace {
+
+struct BenchOptions {
+    size_t mb = 256;                // live volume before freeing
+    unsigned threads = 8;
+    unsigned repeat = 3;            // median of this many runs
+    uint64_t seed = 42;
+};
+
+struct Sample {
+    uint64_t rssKB = 0;             // after the pattern is built
+    uint64_t releasedKB = 0;
+    double trimMs = 0;
+    double trimCpuMs = 0;
+    double reallocMs = 0;
+    uint64_t reallocFaults = 0;
+};
+
+// xorshift64*: same sequence for a given seed on every run and libc.
+struct Rng {
+    uint64_t s;
+    explicit Rng(uint64_t seed) : s(seed ? seed : 1) {}
+    uint64_t next() {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return s * 2685821657736338717ULL;
+    }
+    size_t range(size_t lo, size_t hi) { return lo + (size_t)(next() % (hi - lo + 1)); }
+};
+
+double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+uint64_t rssKB() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    unsigned long long size = 0, resident = 0;
+    if (f) {
+        if (fscanf(f, "%llu %llu", &size, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+uint64_t minorFaults() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)ru.ru_minflt;
+}
+
+void touch(char* p, size_t n) {
+    for (size_t i = 0; i < n; i += 4096) p[i] = 1;
+    if (n) p[n - 1] = 1;
+}
+
+// Allocates about budget bytes in [lo, hi] sized blocks, touching each one,
+// then frees a random (1 - keep) share of them. Survivors are leaked to the
+// caller through `live` so the fragmentation stays in place.
+size_t buildSmallFrees(Rng& rng, size_t budget, size_t lo, size_t hi, double keep, std::vector<void*>& live) {
+    std::vector<std::pair<void*, size_t>> blocks;
+    size_t total = 0;
+    while (total < budget) {
+        size_t n = rng.range(lo, hi);
+        char* p = (char*)malloc(n);
+        touch(p, n);
+        blocks.push_back(std::make_pair((void*)p, n));
+        total += n;
+    }
+    size_t freed = 0;
+    uint64_t keepCut = (uint64_t)(keep * 1000);
+    for (auto& b : blocks) {
+        if (rng.next() % 1000 < keepCut) { live.push_back(b.first); continue; }
+        free(b.first);
+        freed += b.second;
+    }
+    return freed;
+}
+
+size_t buildLargeChurn(Rng& rng, size_t budget, std::vector<void*>& live) {
+    size_t freed = 0;
+    for (int round = 0; round < 4; ++round)
+        freed += buildSmallFrees(rng, budget / 4, 16 * 1024, 120 * 1024, 0.10, live);
+    return freed;
+}
+
+size_t buildArenaSpread(const BenchOptions& o, std::vector<void*>& live) {
+    std::vector<std::thread> threads;
+    std::vector<std::vector<void*>> perThread(o.threads);
+    std::vector<size_t> freed(o.threads);
+    for (unsigned t = 0; t < o.threads; ++t) {
+        threads.emplace_back([&, t] {
+            Rng rng(o.seed + t + 1);
+            freed[t] = buildSmallFrees(rng, o.mb * 1024 * 1024 / o.threads, 16, 512, 0.10, perThread[t]);
+        });
+    }
+    size_t total = 0;
+    for (unsigned t = 0; t < o.threads; ++t) {
+        threads[t].join();
+        live.insert(live.end(), perThread[t].begin(), perThread[t].end());
+        total += freed[t];
+    }
+    return total;
+}
+
+size_t buildTopPinned(Rng& rng, size_t budget, std::vector<void*>& live) {
+    std::vector<std::pair<void*, size_t>> blocks;
+    size_t total = 0;
+    while (total < budget) {
+        size_t n = rng.range(1024, 64 * 1024);
+        char* p = (char*)malloc(n);
+        touch(p, n);
+        blocks.push_back(std::make_pair((void*)p, n));
+        total += n;
+    }
+    live.push_back(blocks.back().first);
+    blocks.pop_back();
+    size_t freed = 0;
+    for (auto& b : blocks) { free(b.first); freed += b.second; }
+    return freed;
+}
+
+Sample runPattern(const std::string& name, const BenchOptions& o, bool trim) {
+    Rng rng(o.seed);
+    std::vector<void*> live;
+    live.reserve(1 << 20);
+    size_t budget = o.mb * 1024 * 1024;
+    size_t freed = 0;
+    if (name == "small-frees") freed = buildSmallFrees(rng, budget, 16, 512, 0.10, live);
+    else if (name == "large-churn") freed = buildLargeChurn(rng, budget, live);
+    else if (name == "arena-spread") freed = buildArenaSpread(o, live);
+    else if (name == "top-pinned") freed = buildTopPinned(rng, budget, live);
+
+    Sample s;
+    s.rssKB = rssKB();
+    if (trim) {
+        ex1::TrimResult r;
+        ex1::trimNow(r);
+        s.releasedKB = r.releasedKB;
+        s.trimMs = r.wallMs;
+        s.trimCpuMs = r.cpuMs;
+    }
+
+    // Next allocation: the freed volume again, in mid-sized blocks, touched.
+    uint64_t f0 = minorFaults();
+    double t0 = nowMs();
+    std::vector<char*> again;
+    for (size_t got = 0; got < freed;) {
+        size_t n = rng.range(64, 4096);
+        char* p = (char*)malloc(n);
+        touch(p, n);
+        again.push_back(p);
+        got += n;
+    }
+    s.reallocMs = nowMs() - t0;
+    s.reallocFaults = minorFaults() - f0;
+    return s;
+}
+
+// Runs the pattern in a forked child so every run starts from a clean heap.
+bool runIsolated(const std::string& name, const BenchOptions& o, bool trim, Sample& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) { close(fds[0]); close(fds[1]); return false; }
+    if (pid == 0) {
+        close(fds[0]);
+        Sample s = runPattern(name, o, trim);
+        ssize_t w = write(fds[1], &s, sizeof(s));
+        _exit(w == (ssize_t)sizeof(s) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t r = read(fds[0], &out, sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return r == (ssize_t)sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+template <typename T>
+T medianOf(const std::vector<Sample>& v, T Sample::*field) {
+    std::vector<T> xs;
+    for (const Sample& s : v) xs.push_back(s.*field);
+    std::sort(xs.begin(), xs.end());
+    return xs[xs.size() / 2];
+}
+
+// Median per field over the repeats.
+Sample median(const std::vector<Sample>& v) {
+    Sample m;
+    m.rssKB = medianOf(v, &Sample::rssKB);
+    m.releasedKB = medianOf(v, &Sample::releasedKB);
+    m.trimMs = medianOf(v, &Sample::trimMs);
+    m.trimCpuMs = medianOf(v, &Sample::trimCpuMs);
+    m.reallocMs = medianOf(v, &Sample::reallocMs);
+    m.reallocFaults = medianOf(v, &Sample::reallocFaults);
+    return m;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions o;
+    std::vector<std::string> patterns;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--mb" && i + 1 < argc) o.mb = std::stoul(argv[++i]);
+        else if (a == "--threads" && i + 1 < argc) o.threads = std::max(1ul, std::stoul(argv[++i]));
+        else if (a == "--repeat" && i + 1 < argc) o.repeat = std::max(1ul, std::stoul(argv[++i]));
+        else if (a == "--seed" && i + 1 < argc) o.seed = std::stoull(argv[++i]);
+        else if (a == "small-frees" || a == "large-churn" || a == "arena-spread" || a == "top-pinned") patterns.push_back(a);
+        else {
+            std::cout << "Usage: " << argv[0] << " [--mb N] [--threads N] [--repeat N] [--seed N]"
+                      << " [small-frees|large-churn|arena-spread|top-pinned ...]\n";
+            return 1;
+        }
+    }
+    if (patterns.empty()) patterns = {"small-frees", "large-churn", "arena-spread", "top-pinned"};
+
+    std::cout << "Trim benchmark: " << o.mb << " MB per pattern, " << o.threads << " threads, median of "
+              << o.repeat << ", seed " << o.seed << "\n";
+    char line[200];
+    snprintf(line, sizeof(line), "%-13s %9s %9s %9s %9s %11s %9s %11s %9s\n", "pattern", "rssKB", "freedKB",
+             "trimMs", "trimCpu", "reallocMs", "faults", "noTrimMs", "faults");
+    std::cout << line;
+    for (const std::string& p : patterns) {
+        std::vector<Sample> withTrim, without;
+        for (unsigned r = 0; r < o.repeat; ++r) {
+            Sample a, b;
+            if (!runIsolated(p, o, true, a) || !runIsolated(p, o, false, b)) {
+                std::cout << p << ": run failed\n";
+                return 1;
+            }
+            withTrim.push_back(a);
+            without.push_back(b);
+        }
+        Sample t = median(withTrim), n = median(without);
+        snprintf(line, sizeof(line), "%-13s %9llu %9llu %9.2f %9.2f %11.2f %9llu %11.2f %9llu\n", p.c_str(),
+                 (unsigned long long)t.rssKB, (unsigned long long)t.releasedKB, t.trimMs, t.trimCpuMs,
+                 t.reallocMs, (unsigned long long)t.reallocFaults, n.reallocMs,
+                 (unsigned long long)n.reallocFaults);
+        std::cout << line;
+    }
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cout << "The trim benchmark needs Linux (/proc/self/statm, fork).\n";
+    return 0;
+}
+
+#endif
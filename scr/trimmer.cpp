@@ -0,0 +1,533 @@
+// Recortador en segundo plano (ver trimmer.h). Solo Linux: en otras plataformas
+// startBackgroundTrimmer() y trimNow() devuelven false.
+
+#include "trimmer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#endif
+
+namespace ex1 {
+
+#ifdef __linux__
+namespace {
+
+double clockMs(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Small /proc reads with plain syscalls: nothing here allocates, so sampling
+// does not itself grow the heap it is watching.
+ssize_t readSmallFile(const char* path, char* buf, size_t cap) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, cap - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+uint64_t readRssKB() {
+    char buf[128];
+    if (readSmallFile("/proc/self/statm", buf, sizeof(buf)) <= 0) return 0;
+    char* p = buf;
+    std::strtoull(p, &p, 10);                          // size
+    unsigned long long pages = std::strtoull(p, nullptr, 10);
+    return pages * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+double readPsiSomeAvg10() {
+    char buf[256];
+    if (readSmallFile("/proc/pressure/memory", buf, sizeof(buf)) <= 0) return -1.0;
+    const char* p = std::strstr(buf, "avg10=");        // first line is "some"
+    return p ? std::strtod(p + 6, nullptr) : -1.0;
+}
+
+double rusageMs(int who) {
+    struct rusage ru;
+    if (getrusage(who, &ru) != 0) return 0;
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+typedef int (*MallctlFn)(const char*, void*, size_t*, void*, size_t);
+typedef void (*TcReleaseFn)();
+typedef int (*TcNumericPropertyFn)(const char*, size_t*);
+
+struct Allocator {
+    MallctlFn mallctl = nullptr;
+    TcReleaseFn tcRelease = nullptr;
+    TcNumericPropertyFn tcProperty = nullptr;
+};
+
+// Same rule as ex1 trim: an allocator counts only if it provides malloc.
+bool providesMalloc(void* sym) {
+    Dl_info a, b;
+    void* m = dlsym(RTLD_DEFAULT, "malloc");
+    return sym && m && dladdr(sym, &a) && dladdr(m, &b) && a.dli_fname && b.dli_fname &&
+           std::strcmp(a.dli_fname, b.dli_fname) == 0;
+}
+
+const Allocator& allocator() {
+    static const Allocator a = [] {
+        Allocator r;
+        void* mallctl = dlsym(RTLD_DEFAULT, "mallctl");
+        void* tcRelease = dlsym(RTLD_DEFAULT, "MallocExtension_ReleaseFreeMemory");
+        if (providesMalloc(mallctl)) {
+            r.mallctl = (MallctlFn)mallctl;
+        } else if (providesMalloc(tcRelease)) {
+            r.tcRelease = (TcReleaseFn)tcRelease;
+            r.tcProperty = (TcNumericPropertyFn)dlsym(RTLD_DEFAULT, "MallocExtension_GetNumericProperty");
+        }
+        return r;
+    }();
+    return a;
+}
+
+size_t jemallocResident(MallctlFn mallctl) {
+    uint64_t epoch = 1;
+    size_t len = sizeof(epoch);
+    mallctl("epoch", &epoch, &len, &epoch, len);
+    size_t v = 0;
+    len = sizeof(v);
+    return mallctl("stats.resident", &v, &len, nullptr, 0) == 0 ? v : 0;
+}
+
+size_t tcmallocUnmapped(TcNumericPropertyFn prop) {
+    size_t v = 0;
+    if (prop) prop("tcmalloc.pageheap_unmapped_bytes", &v);
+    return v;
+}
+
+size_t jemallocSize(MallctlFn mallctl, const char* name) {
+    size_t v = 0, len = sizeof(v);
+    return mallctl(name, &v, &len, nullptr, 0) == 0 ? v : 0;
+}
+
+uint64_t xmlAttr(const char* tag, const char* end, const char* name) {
+    std::string key = std::string(name) + "=\"";
+    const char* p = std::search(tag, end, key.begin(), key.end());
+    return p == end ? 0 : std::strtoull(p + key.size(), nullptr, 10);
+}
+
+// Trimmer thread state; mu guards everything but the activity timestamp.
+struct TrimmerState {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::thread thread;
+    bool stop = false;
+    BackgroundTrimOptions opts;
+    BackgroundTrimStats stats;
+};
+
+// Constructed in static storage and never destroyed: exit() may run while
+// the trimmer thread still waits on cv, and destroying a condition variable
+// with a waiter blocks forever. A forked child has no trimmer thread (and
+// may inherit mu locked by it), so it gets a fresh state built over the old
+// one, which is abandoned rather than destroyed.
+alignas(TrimmerState) unsigned char g_stateStorage[sizeof(TrimmerState)];
+
+void resetStateInChild() { new (g_stateStorage) TrimmerState(); }
+
+TrimmerState& st() {
+    static TrimmerState* s = [] {
+        pthread_atfork(nullptr, nullptr, resetStateInChild);
+        return new (g_stateStorage) TrimmerState();
+    }();
+    return *s;
+}
+std::atomic<int64_t> g_lastActivityMs{0};
+thread_local bool t_isTrimmer = false;
+double g_glibcMsPerMB = -1;             // malloc_trim cost per MB of arena, EWMA
+// Assumed until a trim has been measured, so the first targeted trim of a
+// large heap is not an unbounded malloc_trim. On the trim benchmark's
+// fragmented heaps malloc_trim costs 0.1-0.4 ms per MB.
+const double kGlibcDefaultMsPerMB = 0.5;
+
+void learnGlibcCost(double wallMs, uint64_t systemBytes) {
+    if (systemBytes < 1024 * 1024) return;
+    double sample = wallMs / (systemBytes / (1024.0 * 1024.0));
+    std::lock_guard<std::mutex> lk(st().mu);
+    g_glibcMsPerMB = g_glibcMsPerMB < 0 ? sample : 0.7 * g_glibcMsPerMB + 0.3 * sample;
+}
+
+void recordTrim(TrimReason reason, const TrimResult& r) {
+    TrimmerState& s = st();
+    std::lock_guard<std::mutex> lk(s.mu);
+    s.stats.trims[reason]++;
+    s.stats.releasedKB += r.releasedKB;
+    s.stats.lastTrimMs = r.wallMs;
+    s.stats.maxTrimMs = std::max(s.stats.maxTrimMs, r.wallMs);
+    s.stats.totalTrimMs += r.wallMs;
+}
+
+void trimmerLoop() {
+    t_isTrimmer = true;
+    TrimmerState& s = st();
+    BackgroundTrimOptions opts;
+    {
+        std::lock_guard<std::mutex> lk(s.mu);
+        opts = s.opts;
+    }
+    if (opts.lowPriority) setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+
+    unsigned interval = std::max(1u, opts.minIntervalMs);
+    uint64_t mark = opts.highWaterKB ? opts.highWaterKB : readRssKB();
+    double lastTrim = -1e18;
+    double idleSince = -1;              // start of the current idle period
+    bool idleTrimmed = false;           // one idle trim per idle period
+    double lastCheck = clockMs(CLOCK_MONOTONIC);
+    double lastCpu = rusageMs(RUSAGE_SELF) - rusageMs(RUSAGE_THREAD);
+
+    std::unique_lock<std::mutex> lk(s.mu);
+    s.stats.highWaterKB = mark;
+    s.stats.currentIntervalMs = interval;
+    while (!s.cv.wait_for(lk, std::chrono::milliseconds(opts.checkIntervalMs), [&s] { return s.stop; })) {
+        s.stats.checks++;
+        lk.unlock();
+
+        double now = clockMs(CLOCK_MONOTONIC);
+        double cpu = rusageMs(RUSAGE_SELF) - rusageMs(RUSAGE_THREAD);   // excludes this thread
+        int64_t activity = g_lastActivityMs.load(std::memory_order_relaxed);
+        bool busy = activity != 0 ? now - (double)activity < opts.idleMs
+                                  : 100.0 * (cpu - lastCpu) / std::max(1.0, now - lastCheck) >= opts.idleCpuPct;
+        if (busy) {
+            idleSince = -1;
+            idleTrimmed = false;
+        } else if (idleSince < 0) {
+            idleSince = lastCheck;
+        }
+        bool idle = !busy && (activity != 0 || now - idleSince >= opts.idleMs);
+        lastCheck = now;
+        lastCpu = cpu;
+
+        uint64_t rss = readRssKB();
+        int reason = -1;
+        if (opts.idleMs && idle && !idleTrimmed) reason = TrimIdle;
+        else if (opts.psiSomeMax >= 0 && readPsiSomeAvg10() > opts.psiSomeMax) reason = TrimPressure;
+        else if (opts.highWaterPct > 0 && rss > mark * (1.0 + opts.highWaterPct / 100.0)) reason = TrimHighWater;
+
+        if (reason >= 0 && now - lastTrim < interval) {
+            lk.lock();
+            s.stats.rateLimited++;
+            continue;
+        }
+        if (reason >= 0) {
+            TrimResult r;
+            if (opts.targeted) {
+                ArenaTrimResult ar;
+                trimArenas(opts.arenas, ar);
+                if (ar.skipped) {
+                    // Nothing was trimmed: keep the mark, the rate limit and
+                    // the counters, so a skip cannot raise the high-water mark.
+                    if (reason == TrimIdle) idleTrimmed = true;
+                    lk.lock();
+                    continue;
+                }
+                r.rssAfterKB = readRssKB();
+                r.releasedKB = ar.releasedKB;
+                r.wallMs = ar.pauseMs;
+            } else {
+                trimNow(r);
+            }
+            lastTrim = clockMs(CLOCK_MONOTONIC);
+            if (reason == TrimIdle) idleTrimmed = true;
+            if (!opts.highWaterKB) mark = r.rssAfterKB;
+            // Back off while trims are slow enough to stall allocating threads.
+            if (r.wallMs > opts.maxTrimMs) interval = std::min(interval * 2, std::max(1u, opts.minIntervalMs) * 64);
+            else interval = std::max(std::max(1u, opts.minIntervalMs), interval / 2);
+            recordTrim((TrimReason)reason, r);
+        }
+        lk.lock();
+        s.stats.highWaterKB = mark;
+        s.stats.currentIntervalMs = interval;
+    }
+}
+
+} // namespace
+
+bool trimArenas(const ArenaTrimOptions& opts, ArenaTrimResult& res) {
+    const Allocator& a = allocator();
+    res = ArenaTrimResult();
+    unsigned maxArenas = std::max(1u, opts.maxArenas);
+    if (a.mallctl) {
+        res.allocator = "jemalloc";
+        jemallocResident(a.mallctl);                    // refreshes the stats epoch
+        unsigned narenas = 0;
+        size_t len = sizeof(narenas);
+        a.mallctl("arenas.narenas", &narenas, &len, nullptr, 0);
+        size_t page = jemallocSize(a.mallctl, "arenas.page");
+        char name[64];
+        for (unsigned i = 0; i < narenas; ++i) {
+            ArenaTrimEntry e;
+            e.arena = (int)i;
+            std::snprintf(name, sizeof(name), "stats.arenas.%u.pdirty", i);
+            size_t pages = jemallocSize(a.mallctl, name);
+            std::snprintf(name, sizeof(name), "stats.arenas.%u.pmuzzy", i);
+            pages += jemallocSize(a.mallctl, name);
+            e.freeKB = (uint64_t)pages * page / 1024;
+            res.arenas.push_back(e);
+        }
+        std::sort(res.arenas.begin(), res.arenas.end(),
+                  [](const ArenaTrimEntry& x, const ArenaTrimEntry& y) { return x.freeKB > y.freeKB; });
+        unsigned done = 0;
+        for (ArenaTrimEntry& e : res.arenas) {
+            if (done == maxArenas || e.freeKB == 0 || e.freeKB < opts.minFreeKB) break;
+            if (res.pauseMs >= opts.budgetMs) break;
+            std::snprintf(name, sizeof(name), "stats.arenas.%d.resident", e.arena);
+            size_t before = jemallocSize(a.mallctl, name);
+            char purge[48];
+            std::snprintf(purge, sizeof(purge), "arena.%d.purge", e.arena);
+            double t0 = clockMs(CLOCK_MONOTONIC);
+            a.mallctl(purge, nullptr, nullptr, nullptr, 0);
+            e.pauseMs = clockMs(CLOCK_MONOTONIC) - t0;
+            jemallocResident(a.mallctl);
+            size_t after = jemallocSize(a.mallctl, name);
+            e.releasedKB = before > after ? (before - after) / 1024 : 0;
+            e.trimmed = true;
+            res.releasedKB += e.releasedKB;
+            res.pauseMs += e.pauseMs;
+            ++done;
+        }
+        if (!done) res.skipped = "no arena above the free threshold";
+        return true;
+    }
+    if (a.tcRelease) {
+        // The page heap is one lock: release it in 4 MB steps so each hold is
+        // short, stopping at the budget or when a step frees nothing.
+        res.allocator = "tcmalloc";
+        typedef void (*TcReleaseToSystemFn)(size_t);
+        TcReleaseToSystemFn step = (TcReleaseToSystemFn)dlsym(RTLD_DEFAULT, "MallocExtension_ReleaseToSystem");
+        ArenaTrimEntry e;
+        e.arena = 0;
+        size_t freeBytes = 0;
+        if (a.tcProperty) a.tcProperty("tcmalloc.pageheap_free_bytes", &freeBytes);
+        e.freeKB = freeBytes / 1024;
+        res.arenas.push_back(e);
+        if (e.freeKB < opts.minFreeKB) { res.skipped = "page heap below the free threshold"; return true; }
+        size_t unmapped0 = tcmallocUnmapped(a.tcProperty);
+        if (!step || !a.tcProperty) {
+            double t0 = clockMs(CLOCK_MONOTONIC);
+            a.tcRelease();
+            res.pauseMs = clockMs(CLOCK_MONOTONIC) - t0;
+        } else {
+            for (size_t last = unmapped0; res.pauseMs < opts.budgetMs;) {
+                double t0 = clockMs(CLOCK_MONOTONIC);
+                step(4 << 20);
+                res.pauseMs += clockMs(CLOCK_MONOTONIC) - t0;
+                size_t now = tcmallocUnmapped(a.tcProperty);
+                if (now <= last) break;
+                last = now;
+            }
+        }
+        size_t unmapped1 = tcmallocUnmapped(a.tcProperty);
+        res.arenas[0].trimmed = true;
+        res.arenas[0].pauseMs = res.pauseMs;
+        res.releasedKB = res.arenas[0].releasedKB = unmapped1 > unmapped0 ? (unmapped1 - unmapped0) / 1024 : 0;
+        return true;
+    }
+#if defined(__GLIBC__)
+    res.allocator = "glibc";
+    uint64_t systemBytes = 0, topFree = 0;
+    for (const MallocArenaInfo& ma : mallocArenaInfo()) {
+        ArenaTrimEntry e;
+        e.arena = ma.nr;
+        e.freeKB = (ma.fastBytes + ma.restBytes) / 1024;
+        res.arenas.push_back(e);
+        systemBytes += ma.systemBytes;
+    }
+    std::sort(res.arenas.begin(), res.arenas.end(),
+              [](const ArenaTrimEntry& x, const ArenaTrimEntry& y) { return x.freeKB > y.freeKB; });
+    for (size_t i = 0; i < res.arenas.size() && i < maxArenas; ++i) topFree += res.arenas[i].freeKB;
+    {
+        std::lock_guard<std::mutex> lk(st().mu);
+        double msPerMB = g_glibcMsPerMB >= 0 ? g_glibcMsPerMB : kGlibcDefaultMsPerMB;
+        res.predictedMs = msPerMB * systemBytes / (1024.0 * 1024.0);
+    }
+    if (topFree < opts.minFreeKB) { res.skipped = "top arenas below the free threshold"; return true; }
+    if (res.predictedMs > opts.budgetMs) { res.skipped = "predicted pause over budget"; return true; }
+
+    uint64_t rss0 = readRssKB();
+    double t0 = clockMs(CLOCK_MONOTONIC);
+    malloc_trim(0);
+    res.pauseMs = clockMs(CLOCK_MONOTONIC) - t0;
+    uint64_t rss1 = readRssKB();
+    learnGlibcCost(res.pauseMs, systemBytes);
+    res.releasedKB = rss0 > rss1 ? rss0 - rss1 : 0;
+    // malloc_trim has no narrower scope and no per-arena figures: one entry
+    // for the whole trim, ahead of the per-arena rows it was gated on.
+    ArenaTrimEntry all;
+    all.arena = kAllArenas;
+    for (const ArenaTrimEntry& e : res.arenas) all.freeKB += e.freeKB;
+    all.releasedKB = res.releasedKB;
+    all.pauseMs = res.pauseMs;
+    all.trimmed = true;
+    res.arenas.insert(res.arenas.begin(), all);
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::vector<MallocArenaInfo> mallocArenaInfo() {
+    std::vector<MallocArenaInfo> arenas;
+#if defined(__GLIBC__)
+    char* data = nullptr;
+    size_t size = 0;
+    FILE* f = open_memstream(&data, &size);
+    if (!f) return arenas;
+    malloc_info(0, f);
+    fclose(f);
+    const char* xml = data;
+    const char* xmlEnd = data + size;
+    for (const char* h = std::strstr(xml, "<heap nr=\""); h; h = std::strstr(h + 1, "<heap nr=\"")) {
+        const char* end = std::strstr(h, "</heap>");
+        if (!end) break;
+        MallocArenaInfo a;
+        a.nr = (int)std::strtol(h + 10, nullptr, 10);
+        const char* t = std::strstr(h, "</sizes>");     // the totals follow <sizes>
+        if (!t || t > end) t = h;
+        for (const char* lt = std::strchr(t + 1, '<'); lt && lt < end; lt = std::strchr(lt + 1, '<')) {
+            const char* gt = std::find(lt, xmlEnd, '>');
+            if (std::strncmp(lt, "<total type=\"fast\"", 18) == 0) {
+                a.fastCount = xmlAttr(lt, gt, "count");
+                a.fastBytes = xmlAttr(lt, gt, "size");
+            } else if (std::strncmp(lt, "<total type=\"rest\"", 18) == 0) {
+                a.restCount = xmlAttr(lt, gt, "count");
+                a.restBytes = xmlAttr(lt, gt, "size");
+            } else if (std::strncmp(lt, "<system type=\"current\"", 22) == 0) {
+                a.systemBytes = xmlAttr(lt, gt, "size");
+            }
+        }
+        arenas.push_back(a);
+    }
+    free(data);
+#endif
+    return arenas;
+}
+
+bool trimNow(TrimResult& r) {
+    const Allocator& a = allocator();
+#if defined(__GLIBC__)
+    // Arena size for the cost model, read before the RSS sample so nothing
+    // allocates between the two samples: malloc_info() needs a memstream,
+    // mallinfo2() (glibc 2.33+) reports the same sum without allocating.
+    uint64_t systemBytes = 0;
+    if (!a.mallctl && !a.tcRelease) {
+#if __GLIBC_PREREQ(2, 33)
+        systemBytes = mallinfo2().arena;
+#else
+        for (const MallocArenaInfo& ma : mallocArenaInfo()) systemBytes += ma.systemBytes;
+#endif
+    }
+#endif
+    double wall0 = clockMs(CLOCK_MONOTONIC), cpu0 = clockMs(CLOCK_THREAD_CPUTIME_ID);
+    r.rssBeforeKB = readRssKB();
+    uint64_t allocatorKB = 0;
+    bool haveAllocatorFigure = false;
+    if (a.mallctl) {
+        r.allocator = "jemalloc";
+        size_t before = jemallocResident(a.mallctl);
+        a.mallctl("arena.4096.purge", nullptr, nullptr, nullptr, 0);   // MALLCTL_ARENAS_ALL
+        size_t after = jemallocResident(a.mallctl);
+        allocatorKB = before > after ? (before - after) / 1024 : 0;
+        haveAllocatorFigure = true;
+    } else if (a.tcRelease) {
+        r.allocator = "tcmalloc";
+        size_t before = tcmallocUnmapped(a.tcProperty);
+        a.tcRelease();
+        size_t after = tcmallocUnmapped(a.tcProperty);
+        allocatorKB = after > before ? (after - before) / 1024 : 0;
+        haveAllocatorFigure = a.tcProperty != nullptr;
+    } else {
+#if defined(__GLIBC__)
+        r.allocator = "glibc";
+        double t0 = clockMs(CLOCK_MONOTONIC);
+        malloc_trim(0);
+        learnGlibcCost(clockMs(CLOCK_MONOTONIC) - t0, systemBytes);
+#else
+        return false;
+#endif
+    }
+    r.rssAfterKB = readRssKB();
+    r.wallMs = clockMs(CLOCK_MONOTONIC) - wall0;
+    r.cpuMs = clockMs(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    r.releasedKB = haveAllocatorFigure ? allocatorKB
+                                       : (r.rssBeforeKB > r.rssAfterKB ? r.rssBeforeKB - r.rssAfterKB : 0);
+    if (!t_isTrimmer) recordTrim(TrimManual, r);
+    return true;
+}
+
+bool startBackgroundTrimmer(const BackgroundTrimOptions& opts) {
+    TrimmerState& s = st();
+    std::lock_guard<std::mutex> lk(s.mu);
+    if (s.thread.joinable()) return false;
+    s.opts = opts;
+    s.stop = false;
+    s.stats = BackgroundTrimStats();
+    s.stats.running = true;
+    s.thread = std::thread(trimmerLoop);
+    return true;
+}
+
+void stopBackgroundTrimmer() {
+    TrimmerState& s = st();
+    std::thread t;
+    {
+        std::lock_guard<std::mutex> lk(s.mu);
+        if (!s.thread.joinable()) return;
+        s.stop = true;
+        t = std::move(s.thread);
+    }
+    s.cv.notify_all();
+    t.join();
+    std::lock_guard<std::mutex> lk(s.mu);
+    s.stats.running = false;
+}
+
+void noteActivity() {
+    g_lastActivityMs.store((int64_t)clockMs(CLOCK_MONOTONIC), std::memory_order_relaxed);
+}
+
+BackgroundTrimStats backgroundTrimmerStats() {
+    std::lock_guard<std::mutex> lk(st().mu);
+    return st().stats;
+}
+
+#else
+
+bool trimArenas(const ArenaTrimOptions&, ArenaTrimResult&) { return false; }
+std::vector<MallocArenaInfo> mallocArenaInfo() { return std::vector<MallocArenaInfo>(); }
+bool trimNow(TrimResult&) { return false; }
+bool startBackgroundTrimmer(const BackgroundTrimOptions&) { return false; }
+void stopBackgroundTrimmer() {}
+void noteActivity() {}
+BackgroundTrimStats backgroundTrimmerStats() { return BackgroundTrimStats(); }
+
+#endif
+
+} // namespace ex1
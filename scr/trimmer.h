@@ -0,0 +1,124 @@
+// Recortador en segundo plano para enlazar dentro de un servicio: devuelve al
+// sistema la memoria libre del heap cuando el proceso está ocioso, cuando sube
+// la presión de memoria (PSI) o cuando el RSS supera la marca de agua.
+
+#ifndef EX1_TRIMMER_H
+#define EX1_TRIMMER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace ex1 {
+
+// Contract (inputs/outputs):
+// - startBackgroundTrimmer(opts): starts one trimmer thread for the process;
+//   false if one is already running or the platform is not Linux.
+// - stopBackgroundTrimmer(): wakes and joins the thread; safe to call twice.
+// - noteActivity(): optional, called by request threads (one relaxed atomic
+//   store) so "idle" means no requests rather than low CPU.
+// - trimNow(result): one allocator-aware trim on the calling thread (jemalloc
+//   and tcmalloc purge APIs when they provide malloc, else malloc_trim).
+// - backgroundTrimmerStats(): counters and trim latency so far.
+// - trimArenas(opts, result): targeted trim of the arenas holding the most
+//   free memory, bounded by a pause budget; reports pause against bytes.
+// - mallocArenaInfo(): per-arena free chunks and system memory parsed from
+//   glibc's malloc_info(); empty on other allocators' hosts and platforms.
+// Trims run only on the trimmer thread, at most once per minIntervalMs; a trim
+// slower than maxTrimMs doubles that interval (up to 64x) because allocator
+// locks are held for the duration and request threads may be waiting on them.
+
+// Targeted trim. jemalloc purges arena by arena ("arena.<i>.purge"), most
+// dirty first, until maxArenas or the budget is used up. tcmalloc releases
+// the page heap in steps until the budget is used up. glibc gets a gated
+// trim, not a targeted one: it has no per-arena entry point and malloc_trim
+// walks every arena, so arenas are ranked from malloc_info only to decide
+// whether to trim at all (the top maxArenas hold minFreeKB and the pause
+// predicted from earlier trims, ms per MB of arena and 0.5 ms per MB until one
+// has been measured, fits the budget). The trim is then reported as one
+// kAllArenas entry; the ranked per-arena rows stay untrimmed.
+struct ArenaTrimOptions {
+    unsigned maxArenas = 4;
+    double budgetMs = 5.0;
+    uint64_t minFreeKB = 1024;
+};
+
+const int kAllArenas = -1;             // glibc: malloc_trim over every arena
+
+struct ArenaTrimEntry {
+    int arena = kAllArenas;
+    uint64_t freeKB = 0;               // glibc: free chunks; jemalloc: dirty + muzzy pages
+    uint64_t releasedKB = 0;           // per arena where the allocator reports it
+    double pauseMs = 0;
+    bool trimmed = false;
+};
+
+struct ArenaTrimResult {
+    const char* allocator = "none";
+    std::vector<ArenaTrimEntry> arenas; // most free first
+    uint64_t releasedKB = 0;
+    double pauseMs = 0;                 // total time allocator locks were held
+    double predictedMs = -1;            // glibc only, -1 for other allocators
+    const char* skipped = nullptr;      // reason nothing was trimmed
+};
+
+struct BackgroundTrimOptions {
+    unsigned checkIntervalMs = 1000;   // how often idle, PSI and RSS are sampled
+    unsigned idleMs = 2000;            // idle for this long before an idle trim (0 disables)
+    double idleCpuPct = 2.0;           // without noteActivity(): idle below this process CPU
+    double psiSomeMax = 10.0;          // trim when memory "some" avg10 exceeds this (< 0 disables)
+    double highWaterPct = 20.0;        // trim when RSS grows this % over the high-water mark (0 disables)
+    uint64_t highWaterKB = 0;          // fixed mark; 0 uses the RSS left by the last trim
+    unsigned minIntervalMs = 5000;     // rate limit between any two trims
+    unsigned maxTrimMs = 20;           // slower trims back off the rate limit
+    // nice 19 for the trimmer thread. Off by default: a trim holds allocator
+    // locks, and a nice 19 holder preempted under load stalls request threads.
+    bool lowPriority = false;
+    bool targeted = false;             // trim with trimArenas(arenas) instead of trimNow()
+    ArenaTrimOptions arenas;
+};
+
+enum TrimReason { TrimIdle, TrimPressure, TrimHighWater, TrimManual, TrimReasonCount };
+
+struct TrimResult {
+    const char* allocator = "none";    // "glibc", "jemalloc" or "tcmalloc"
+    uint64_t rssBeforeKB = 0;
+    uint64_t rssAfterKB = 0;
+    uint64_t releasedKB = 0;           // allocator's own figure, else the RSS drop
+    double wallMs = 0;
+    double cpuMs = 0;
+};
+
+struct BackgroundTrimStats {
+    bool running = false;
+    uint64_t checks = 0;
+    uint64_t trims[TrimReasonCount] = {};
+    uint64_t rateLimited = 0;          // a trigger fired inside the rate-limit window
+    uint64_t releasedKB = 0;
+    uint64_t highWaterKB = 0;
+    double lastTrimMs = 0;
+    double maxTrimMs = 0;
+    double totalTrimMs = 0;
+    unsigned currentIntervalMs = 0;    // minIntervalMs after backoff
+};
+
+// One <heap> of malloc_info(): free chunks in fastbins and in the other bins,
+// and the memory the arena holds from the system.
+struct MallocArenaInfo {
+    int nr = -1;
+    uint64_t fastCount = 0, fastBytes = 0;
+    uint64_t restCount = 0, restBytes = 0;
+    uint64_t systemBytes = 0;
+};
+
+bool trimArenas(const ArenaTrimOptions& opts, ArenaTrimResult& result);
+std::vector<MallocArenaInfo> mallocArenaInfo();
+
+bool startBackgroundTrimmer(const BackgroundTrimOptions& opts = BackgroundTrimOptions());
+void stopBackgroundTrimmer();
+void noteActivity();
+bool trimNow(TrimResult& result);
+BackgroundTrimStats backgroundTrimmerStats();
+
+} // namespace ex1
+
+#endif